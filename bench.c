@@ -0,0 +1,1084 @@
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "dstring.h"
+
+#define NS_PER_SEC                  1000000000.0
+#define MIN_BENCH_NS                20000000.0
+#define MAX_WALL_NS                 1000000000.0
+#define MAX_BATCH_BYTES             ((size_t)1 << 26)
+#define MAX_MUTATING_BATCH          ((size_t)4096)
+#define MIN_SIZE                    ((size_t)16)
+#define DEFAULT_MAX_SIZE            ((size_t)1 << 20)
+#define SIZE_STEP_SHIFT             4
+#define NEEDLE_STRIDE               64
+#define BENCH_FILE_PATH             "dstring_bench.tmp"
+#define BENCH_SNAPSHOT_PATH         "dstring_bench.snap"
+#define NUM_OF_BENCH_FILES          4
+#define NUM_OF_BENCH_CMDS           4
+#define BENCH_CHUNK_SIZE            4096
+#define NEEDLE                      "needle,"
+#define SEPARATOR                   ","
+#define FILLER                      "the quick brown fox jumps over the lazy dog "
+#define NUMBER_LITERAL              "1234567890"
+#define DOUBLE_LITERAL              "12345.6789"
+
+typedef enum bench_variant
+{
+    VARIANT_NONE,
+    VARIANT_HIT,
+    VARIANT_MISS
+} bench_variant_t;
+
+// Hit inputs have NEEDLE every NEEDLE_STRIDE bytes and whitespace
+// on both ends, miss inputs have neither.
+typedef struct bench_input
+{
+    size_t size;
+    bench_variant_t variant;
+    dstr_t *dstr;
+    dstr_t *number;
+    dstr_t *floating;
+    dstr_arr_t *dstr_array;
+    dstr_glob_t *glob;
+    dstr_index_arr_t *index_array;
+    dstr_trans_t *trans;
+    // Escaped and encoded forms of dstr for the unescape and decode cases.
+    dstr_t *json;
+    dstr_t *c_literal;
+    dstr_t *base64;
+    dstr_t *hex;
+    // Filled with the elements of dstr_array.
+    dstr_map_t *map;
+    dstr_intern_t *intern;
+    int null_fd;
+} bench_input_t;
+
+typedef struct bench_case
+{
+    const char *name;
+    // The op changes its dstr, so every op gets its own copy of the input.
+    bool is_mutating;
+    bool has_variants;
+    // The op doesn't depend on the input size, it only runs once.
+    bool is_fixed_size;
+    void (*run)(bench_input_t *input, dstr_t *dstr);
+} bench_case_t;
+
+typedef struct bench_result
+{
+    size_t num_of_ops;
+    double total_ns;
+    size_t num_of_allocs;
+} bench_result_t;
+
+static void run_alloc(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_t *result = dstr_alloc(dstr_get_literal(input->dstr));
+    dstr_free(&result);
+}
+
+static void run_alloc_copy(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_t *result = dstr_alloc_copy(input->dstr);
+    dstr_free(&result);
+}
+
+static void run_append(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_append(dstr, "0123456789abcdef");
+}
+
+static void run_before(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_before(dstr, "0123456789abcdef");
+}
+
+static void run_add(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_t *result = dstr_add(input->dstr, input->dstr);
+    dstr_free(&result);
+}
+
+static void run_subdstr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    int64_t start = (int64_t)(input->size / 4);
+    int64_t end = -start;
+    dstr_t *result = dstr_alloc_subdstr(input->dstr, &start, &end, NULL);
+    dstr_free(&result);
+}
+
+static void run_subdstr_step(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    int64_t step = -2;
+    dstr_t *result = dstr_alloc_subdstr(input->dstr, NULL, NULL, &step);
+    dstr_free(&result);
+}
+
+static void run_utf8_is_valid(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_utf8_is_valid(input->dstr);
+}
+
+static void run_utf8_len(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_utf8_len(dstr);
+}
+
+static void run_utf8_subdstr(bench_input_t *input, dstr_t *dstr)
+{
+    int64_t start = (int64_t)(input->size / 4);
+    int64_t end = -start;
+    dstr_t *result = dstr_alloc_utf8_subdstr(dstr, &start, &end, NULL);
+    dstr_free(&result);
+}
+
+static void run_utf8_char_at(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_utf8_char_at(input->dstr, -1);
+}
+
+static void run_is_substr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_is_substr(dstr_get_literal(input->dstr), NEEDLE);
+}
+
+static void run_is_isubstr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_is_isubstr(dstr_get_literal(input->dstr), "NEEDLE,");
+}
+
+static void run_find(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_find(input->dstr, NEEDLE);
+}
+
+static void run_find_from(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_find_from(input->dstr, NEEDLE, (int64_t)(input->size / 2));
+}
+
+static void run_rfind(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_rfind(input->dstr, NEEDLE);
+}
+
+static void run_find_all(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_find_all(input->dstr, NEEDLE, false, input->index_array);
+}
+
+static void run_ifind(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_ifind(input->dstr, "NEEDLE,");
+}
+
+static void run_count(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_count(input->dstr, NEEDLE, 0, 0);
+}
+
+static void run_icount(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_icount(input->dstr, "NEEDLE,", 0, 0);
+}
+
+static void run_replace(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_replace(dstr, NEEDLE, "pin;");
+}
+
+static void run_ireplace(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_ireplace(dstr, "NEEDLE,", "pin;");
+}
+
+static void run_erase_index(bench_input_t *input, dstr_t *dstr)
+{
+    int64_t start = (int64_t)(input->size / 4);
+    dstr_erase_index(dstr, start, -start);
+}
+
+static void run_splitdstr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_alloc_splitdstr(input->dstr, SEPARATOR, 0);
+    dstr_arr_free(&result);
+}
+
+static void run_split_parallel(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_split_parallel(input->dstr, SEPARATOR, 0);
+    dstr_arr_free(&result);
+}
+
+static void run_split_whitespace(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_split_whitespace(input->dstr, 0);
+    dstr_arr_free(&result);
+}
+
+static void run_split_any(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_split_any(input->dstr, SEPARATOR "\t\n", 0);
+    dstr_arr_free(&result);
+}
+
+static void run_rsplit_whitespace(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_rsplit_whitespace(input->dstr, 0);
+    dstr_arr_free(&result);
+}
+
+static void run_rsplit_any(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_rsplit_any(input->dstr, SEPARATOR "\t\n", 0);
+    dstr_arr_free(&result);
+}
+
+static void run_csv_reader(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_csv_reader_t *reader = dstr_csv_reader_alloc(dstr_get_literal(input->dstr), dstr_get_size(input->dstr), SEPARATOR[0]);
+
+    while (dstr_csv_reader_next(reader))
+    {
+    }
+
+    dstr_csv_reader_free(&reader);
+}
+
+static void run_csv_reader_stream(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    FILE *fp = fopen(BENCH_FILE_PATH, "r");
+    dstr_csv_reader_t *reader = dstr_csv_reader_alloc_stream(fp, SEPARATOR[0]);
+
+    while (dstr_csv_reader_next(reader))
+    {
+    }
+
+    dstr_csv_reader_free(&reader);
+    fclose(fp);
+}
+
+static void run_lstrip(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_lstrip(dstr, "\n ");
+}
+
+static void run_rstrip(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_rstrip(dstr, "\n ");
+}
+
+static void run_strip(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_strip(dstr);
+}
+
+static void run_char_at(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_char_at(input->dstr, -1);
+}
+
+static void run_upper(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_upper(dstr);
+}
+
+static void run_lower(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_lower(dstr);
+}
+
+static void run_swapcase(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_swapcase(dstr);
+}
+
+static void run_capitalize(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_capitalize(dstr);
+}
+
+static void run_title(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_title(dstr);
+}
+
+static void run_translate(bench_input_t *input, dstr_t *dstr)
+{
+    dstr_translate(dstr, input->trans);
+}
+
+static void run_escape_json(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_escape_json(dstr);
+}
+
+// The unescape cases copy an escaped input first, compare with alloc_copy.
+static void run_unescape_json(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_t *result = dstr_alloc_copy(input->json);
+    dstr_unescape_json(result);
+    dstr_free(&result);
+}
+
+static void run_escape_c(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_escape_c(dstr);
+}
+
+static void run_unescape_c(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_t *result = dstr_alloc_copy(input->c_literal);
+    dstr_unescape_c(result);
+    dstr_free(&result);
+}
+
+static void run_quote_shell(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    dstr_quote_shell(dstr);
+}
+
+static void run_append_base64(bench_input_t *input, dstr_t *dstr)
+{
+    dstr_append_base64(dstr, dstr_get_literal(input->dstr), dstr_get_size(input->dstr), false);
+}
+
+static void run_append_hex(bench_input_t *input, dstr_t *dstr)
+{
+    dstr_append_hex(dstr, dstr_get_literal(input->dstr), dstr_get_size(input->dstr));
+}
+
+static void run_decode_base64(bench_input_t *input, dstr_t *dstr)
+{
+    dstr_decode_base64(dstr, dstr_get_literal(input->base64), dstr_get_size(input->base64), false);
+}
+
+static void run_decode_hex(bench_input_t *input, dstr_t *dstr)
+{
+    dstr_decode_hex(dstr, dstr_get_literal(input->hex), dstr_get_size(input->hex));
+}
+
+static void run_classify(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_classify(input->dstr);
+}
+
+static void run_ascii_total(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_ascii_total(input->dstr);
+}
+
+static void run_hash(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_hash_str(dstr_get_literal(input->dstr), dstr_get_size(input->dstr));
+}
+
+static void run_crc32c(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_crc32c(input->dstr);
+}
+
+static void run_digest64(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_digest64(input->dstr);
+}
+
+// Feeds the input in BENCH_CHUNK_SIZE pieces, compare with digest64.
+static void run_digest_update(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    const char *data = dstr_get_literal(input->dstr);
+    size_t size = dstr_get_size(input->dstr);
+    dstr_digest_t *digest = dstr_digest_alloc(0);
+
+    for (size_t i = 0; i < size; i += BENCH_CHUNK_SIZE)
+    {
+        dstr_digest_update(digest, &data[i], (size - i < BENCH_CHUNK_SIZE) ? size - i : BENCH_CHUNK_SIZE);
+    }
+
+    dstr_digest_get(digest);
+    dstr_digest_free(&digest);
+}
+
+static void ascii_total_element(dstr_t *dstr, void *context)
+{
+    (void)context;
+    dstr_ascii_total(dstr);
+}
+
+static void run_arr_parallel_for_each(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_parallel_for_each(input->dstr_array, ascii_total_element, NULL);
+}
+
+static void run_map_alloc_arr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_map_t *map = dstr_map_alloc_arr(input->dstr_array, NULL);
+    dstr_map_free(&map);
+}
+
+static void run_map_set(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_map_t *map = dstr_map_alloc(0);
+
+    for (size_t i = 0; i < dstr_arr_get_size(input->dstr_array); i++)
+    {
+        dstr_map_set(map, dstr_get_literal(dstr_arr_get_index(input->dstr_array, (int64_t)i)), NULL);
+    }
+
+    dstr_map_free(&map);
+}
+
+static void run_map_get(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+
+    for (size_t i = 0; i < dstr_arr_get_size(input->dstr_array); i++)
+    {
+        dstr_map_get(input->map, dstr_get_literal(dstr_arr_get_index(input->dstr_array, (int64_t)i)));
+    }
+}
+
+static void run_intern(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_intern_t *intern = dstr_intern_alloc();
+
+    for (size_t i = 0; i < dstr_arr_get_size(input->dstr_array); i++)
+    {
+        dstr_intern(intern, dstr_get_literal(dstr_arr_get_index(input->dstr_array, (int64_t)i)));
+    }
+
+    dstr_intern_free(&intern);
+}
+
+static void run_intern_find(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+
+    for (size_t i = 0; i < dstr_arr_get_size(input->dstr_array); i++)
+    {
+        dstr_intern_find(input->intern, dstr_get_literal(dstr_arr_get_index(input->dstr_array, (int64_t)i)));
+    }
+}
+
+// Sorting changes the array, so each op splits the input again,
+// compare with split_parallel.
+static void run_arr_sort(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_split_parallel(input->dstr, SEPARATOR, 0);
+    dstr_arr_sort(result, true);
+    dstr_arr_free(&result);
+}
+
+static void run_arr_sort_stable(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_split_parallel(input->dstr, SEPARATOR, 0);
+    dstr_arr_sort_stable(result, true);
+    dstr_arr_free(&result);
+}
+
+static void run_arr_sort_unique(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_t *result = dstr_split_parallel(input->dstr, SEPARATOR, 0);
+    dstr_arr_sort_unique(result, true);
+    dstr_arr_free(&result);
+}
+
+static void run_writer(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_writer_t *writer = dstr_writer_alloc(input->null_fd, 0);
+
+    for (size_t i = 0; i < dstr_arr_get_size(input->dstr_array); i++)
+    {
+        dstr_writer_write_line(writer, dstr_arr_get_index(input->dstr_array, (int64_t)i));
+    }
+
+    dstr_writer_free(&writer);
+}
+
+static void run_arr_write_lines(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_write_lines(input->dstr_array, input->null_fd);
+}
+
+static void run_getline(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    FILE *fp = fopen(BENCH_FILE_PATH, "r");
+    dstr_t *line = dstr_alloc("");
+
+    while (dstr_getline(line, fp))
+    {
+    }
+
+    dstr_free(&line);
+    fclose(fp);
+}
+
+static void run_proc_run_many(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    const char *cmds[NUM_OF_BENCH_CMDS];
+
+    for (size_t i = 0; i < NUM_OF_BENCH_CMDS; i++)
+    {
+        cmds[i] = "echo " NUMBER_LITERAL;
+    }
+
+    dstr_proc_result_t *results = dstr_proc_run_many(cmds, NUM_OF_BENCH_CMDS);
+    dstr_proc_results_free(&results, NUM_OF_BENCH_CMDS);
+}
+
+static void run_arr_read_files(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    const char *paths[NUM_OF_BENCH_FILES];
+
+    for (size_t i = 0; i < NUM_OF_BENCH_FILES; i++)
+    {
+        paths[i] = BENCH_FILE_PATH;
+    }
+
+    dstr_arr_t *result = dstr_arr_read_files(paths, NUM_OF_BENCH_FILES, "rb");
+    dstr_arr_free(&result);
+}
+
+static void run_arr_save_snapshot(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_save_snapshot(input->dstr_array, BENCH_SNAPSHOT_PATH);
+}
+
+static void run_arr_open_snapshot(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    dstr_snapshot_t *snapshot = dstr_arr_open_snapshot(BENCH_SNAPSHOT_PATH);
+    dstr_snapshot_free(&snapshot);
+}
+
+static void run_snapshot_verify(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    dstr_snapshot_t *snapshot = dstr_arr_open_snapshot(BENCH_SNAPSHOT_PATH);
+    dstr_snapshot_verify(snapshot);
+    dstr_snapshot_free(&snapshot);
+}
+
+static void run_ll(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_ll(input->number);
+}
+
+static void run_double(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_double(input->floating);
+}
+
+static void run_ll_to_dstr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    dstr_t *result = dstr_alloc_ll_to_dstr(1234567890);
+    dstr_free(&result);
+}
+
+static void run_ll_to_binary_dstr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    dstr_t *result = dstr_alloc_ll_to_binary_dstr(1234567890, 64);
+    dstr_free(&result);
+}
+
+static void run_str_to_binary_dstr(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    dstr_t *result = dstr_alloc_str_to_binary_dstr(NUMBER_LITERAL, 64);
+    dstr_free(&result);
+}
+
+static void run_glob_match(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_glob_match(input->glob, input->dstr);
+}
+
+static void run_arr_filter_glob(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_filter_glob(input->dstr_array, input->glob, input->index_array);
+}
+
+static void run_arr_cmp(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_arr_cmp_dstr(input->dstr_array, 0, input->dstr);
+}
+
+static void run_write_file(bench_input_t *input, dstr_t *dstr)
+{
+    (void)dstr;
+    dstr_write_file(input->dstr, BENCH_FILE_PATH, "w");
+}
+
+static void run_read_file_binary(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    dstr_t *result = dstr_alloc_read_file(BENCH_FILE_PATH, "rb");
+    dstr_free(&result);
+}
+
+static void run_read_file_text(bench_input_t *input, dstr_t *dstr)
+{
+    (void)input;
+    (void)dstr;
+    dstr_t *result = dstr_alloc_read_file(BENCH_FILE_PATH, "r");
+    dstr_free(&result);
+}
+
+// dstr_alloc_prompt and dstr_alloc_sys_output are left out, one needs a
+// terminal and the other spawns a process per op. proc_run_many spawns
+// NUM_OF_BENCH_CMDS per op, so it only runs once.
+static const bench_case_t bench_cases[] =
+{
+    {"alloc",                   false,  false,  false,  run_alloc},
+    {"alloc_copy",              false,  false,  false,  run_alloc_copy},
+    {"append",                  true,   false,  false,  run_append},
+    {"before",                  true,   false,  false,  run_before},
+    {"add",                     false,  false,  false,  run_add},
+    {"alloc_subdstr",           false,  false,  false,  run_subdstr},
+    {"alloc_subdstr_step",      false,  false,  false,  run_subdstr_step},
+    {"utf8_is_valid",           false,  false,  false,  run_utf8_is_valid},
+    {"utf8_len",                true,   false,  false,  run_utf8_len},
+    {"alloc_utf8_subdstr",      true,   false,  false,  run_utf8_subdstr},
+    {"utf8_char_at",            false,  false,  true,   run_utf8_char_at},
+    {"is_substr",               false,  true,   false,  run_is_substr},
+    {"is_isubstr",              false,  true,   false,  run_is_isubstr},
+    {"find",                    false,  true,   false,  run_find},
+    {"find_from",               false,  true,   false,  run_find_from},
+    {"rfind",                   false,  true,   false,  run_rfind},
+    {"find_all",                false,  true,   false,  run_find_all},
+    {"ifind",                   false,  true,   false,  run_ifind},
+    {"count",                   false,  true,   false,  run_count},
+    {"icount",                  false,  true,   false,  run_icount},
+    {"replace",                 true,   true,   false,  run_replace},
+    {"ireplace",                true,   true,   false,  run_ireplace},
+    {"erase_index",             true,   false,  false,  run_erase_index},
+    {"alloc_splitdstr",         false,  true,   false,  run_splitdstr},
+    {"split_parallel",          false,  true,   false,  run_split_parallel},
+    {"split_whitespace",        false,  true,   false,  run_split_whitespace},
+    {"split_any",               false,  true,   false,  run_split_any},
+    {"rsplit_whitespace",       false,  true,   false,  run_rsplit_whitespace},
+    {"rsplit_any",              false,  true,   false,  run_rsplit_any},
+    {"csv_reader",              false,  true,   false,  run_csv_reader},
+    {"csv_reader_stream",       false,  true,   false,  run_csv_reader_stream},
+    {"lstrip",                  true,   true,   false,  run_lstrip},
+    {"rstrip",                  true,   true,   false,  run_rstrip},
+    {"strip",                   true,   true,   false,  run_strip},
+    {"char_at",                 false,  false,  true,   run_char_at},
+    {"upper",                   true,   false,  false,  run_upper},
+    {"lower",                   true,   false,  false,  run_lower},
+    {"swapcase",                true,   false,  false,  run_swapcase},
+    {"capitalize",              true,   false,  true,   run_capitalize},
+    {"title",                   true,   false,  false,  run_title},
+    {"translate",               true,   false,  false,  run_translate},
+    {"escape_json",             true,   false,  false,  run_escape_json},
+    {"unescape_json",           false,  false,  false,  run_unescape_json},
+    {"escape_c",                true,   false,  false,  run_escape_c},
+    {"unescape_c",              false,  false,  false,  run_unescape_c},
+    {"quote_shell",             true,   false,  false,  run_quote_shell},
+    {"append_base64",           true,   false,  false,  run_append_base64},
+    {"append_hex",              true,   false,  false,  run_append_hex},
+    {"decode_base64",           true,   false,  false,  run_decode_base64},
+    {"decode_hex",              true,   false,  false,  run_decode_hex},
+    {"classify",                false,  false,  false,  run_classify},
+    {"ascii_total",             false,  false,  false,  run_ascii_total},
+    {"hash",                    false,  false,  false,  run_hash},
+    {"crc32c",                  false,  false,  false,  run_crc32c},
+    {"digest64",                false,  false,  false,  run_digest64},
+    {"digest_update",           false,  false,  false,  run_digest_update},
+    {"ll",                      false,  false,  true,   run_ll},
+    {"double",                  false,  false,  true,   run_double},
+    {"alloc_ll_to_dstr",        false,  false,  true,   run_ll_to_dstr},
+    {"alloc_ll_to_binary_dstr", false,  false,  true,   run_ll_to_binary_dstr},
+    {"alloc_str_to_binary_dstr",false,  false,  true,   run_str_to_binary_dstr},
+    {"glob_match",              false,  true,   false,  run_glob_match},
+    {"arr_filter_glob",         false,  true,   false,  run_arr_filter_glob},
+    {"arr_cmp_dstr",            false,  false,  false,  run_arr_cmp},
+    {"arr_parallel_for_each",   false,  false,  false,  run_arr_parallel_for_each},
+    {"map_alloc_arr",           false,  false,  false,  run_map_alloc_arr},
+    {"map_set",                 false,  false,  false,  run_map_set},
+    {"map_get",                 false,  false,  false,  run_map_get},
+    {"intern",                  false,  false,  false,  run_intern},
+    {"intern_find",             false,  false,  false,  run_intern_find},
+    {"arr_sort",                false,  false,  false,  run_arr_sort},
+    {"arr_sort_stable",         false,  false,  false,  run_arr_sort_stable},
+    {"arr_sort_unique",         false,  false,  false,  run_arr_sort_unique},
+    {"writer_write_line",       false,  false,  false,  run_writer},
+    {"arr_write_lines",         false,  false,  false,  run_arr_write_lines},
+    {"arr_save_snapshot",       false,  false,  false,  run_arr_save_snapshot},
+    {"arr_open_snapshot",       false,  false,  false,  run_arr_open_snapshot},
+    {"snapshot_verify",         false,  false,  false,  run_snapshot_verify},
+    {"proc_run_many",           false,  false,  true,   run_proc_run_many},
+    {"write_file",              false,  false,  false,  run_write_file},
+    {"alloc_read_file_binary",  false,  false,  false,  run_read_file_binary},
+    {"alloc_read_file_text",    false,  false,  false,  run_read_file_text},
+    {"getline",                 false,  false,  false,  run_getline},
+    {"arr_read_files",          false,  false,  false,  run_arr_read_files}
+};
+
+static double get_time_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((double)now.tv_sec * NS_PER_SEC) + (double)now.tv_nsec;
+}
+
+static const char *get_variant_name(bench_variant_t variant)
+{
+    switch (variant)
+    {
+        case VARIANT_HIT:
+            return "hit";
+        case VARIANT_MISS:
+            return "miss";
+        case VARIANT_NONE:
+            return "-";
+    }
+
+    return "";
+}
+
+static void setup_input(bench_input_t *input, size_t size, bench_variant_t variant)
+{
+    char *data = malloc(sizeof(char) * (size + 1));
+    size_t filler_size = strlen(FILLER);
+    size_t needle_size = strlen(NEEDLE);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = FILLER[i % filler_size];
+    }
+
+    if (variant == VARIANT_HIT)
+    {
+        for (size_t i = NEEDLE_STRIDE - needle_size; i + needle_size <= size; i += NEEDLE_STRIDE)
+        {
+            memcpy(&data[i], NEEDLE, needle_size);
+        }
+
+        data[0] = ' ';
+        data[size - 1] = '\n';
+    }
+    else
+    {
+        data[0] = 'x';
+        data[size - 1] = 'x';
+    }
+
+    data[size] = '\0';
+
+    input->size = size;
+    input->variant = variant;
+    input->dstr = dstr_alloc(data);
+    input->number = dstr_alloc(NUMBER_LITERAL);
+    input->floating = dstr_alloc(DOUBLE_LITERAL);
+    input->dstr_array = dstr_alloc_splitdstr(input->dstr, SEPARATOR, 0);
+    input->glob = dstr_glob_alloc("*needle");
+    input->index_array = dstr_index_arr_alloc();
+    input->trans = dstr_maketrans("aeiou", "AEIOU", ",");
+    input->json = dstr_alloc_copy(input->dstr);
+    input->base64 = dstr_alloc("");
+    input->hex = dstr_alloc("");
+    input->map = dstr_map_alloc_arr(input->dstr_array, NULL);
+    input->intern = dstr_intern_alloc();
+    input->null_fd = open("/dev/null", O_WRONLY);
+
+    // Tabs give the escaped inputs an escape in every word.
+    dstr_replace(input->json, " ", "\t");
+    input->c_literal = dstr_alloc_copy(input->json);
+    dstr_escape_json(input->json);
+    dstr_escape_c(input->c_literal);
+    dstr_append_base64(input->base64, data, size, false);
+    dstr_append_hex(input->hex, data, size);
+
+    for (size_t i = 0; i < dstr_arr_get_size(input->dstr_array); i++)
+    {
+        dstr_intern_dstr(input->intern, dstr_arr_get_index(input->dstr_array, (int64_t)i));
+    }
+
+    dstr_write_file(input->dstr, BENCH_FILE_PATH, "w");
+    dstr_arr_save_snapshot(input->dstr_array, BENCH_SNAPSHOT_PATH);
+    free(data);
+}
+
+static void free_input(bench_input_t *input)
+{
+    dstr_free(&input->dstr);
+    dstr_free(&input->number);
+    dstr_free(&input->floating);
+    dstr_arr_free(&input->dstr_array);
+    dstr_glob_free(&input->glob);
+    dstr_index_arr_free(&input->index_array);
+    dstr_trans_free(&input->trans);
+    dstr_free(&input->json);
+    dstr_free(&input->c_literal);
+    dstr_free(&input->base64);
+    dstr_free(&input->hex);
+    dstr_map_free(&input->map);
+    dstr_intern_free(&input->intern);
+    close(input->null_fd);
+    remove(BENCH_FILE_PATH);
+    remove(BENCH_SNAPSHOT_PATH);
+}
+
+// Runs ops in batches until MIN_BENCH_NS of op time has passed. Mutating ops
+// get their copies allocated before the timer starts and freed after it stops,
+// MAX_WALL_NS stops cheap ops on large inputs from spending forever on copies.
+static bench_result_t run_case(const bench_case_t *bench_case, bench_input_t *input)
+{
+    bench_result_t result = {0, 0.0, 0};
+    size_t batch_size = 1;
+    size_t max_batch_size = SIZE_MAX;
+
+    if (bench_case->is_mutating)
+    {
+        max_batch_size = MAX_BATCH_BYTES / input->size;
+        max_batch_size = (max_batch_size > MAX_MUTATING_BATCH) ? MAX_MUTATING_BATCH : max_batch_size;
+        max_batch_size = (max_batch_size == 0) ? 1 : max_batch_size;
+    }
+
+    double wall_start = get_time_ns();
+
+    while (result.total_ns < MIN_BENCH_NS && (get_time_ns() - wall_start) < MAX_WALL_NS)
+    {
+        dstr_t **copies = NULL;
+
+        if (bench_case->is_mutating)
+        {
+            copies = malloc(sizeof(dstr_t*) * batch_size);
+
+            for (size_t i = 0; i < batch_size; i++)
+            {
+                copies[i] = dstr_alloc_copy(input->dstr);
+            }
+        }
+
+        size_t allocs_before = dstr_get_num_of_allocs();
+        double start = get_time_ns();
+
+        for (size_t i = 0; i < batch_size; i++)
+        {
+            bench_case->run(input, (copies == NULL) ? NULL : copies[i]);
+        }
+
+        result.total_ns += get_time_ns() - start;
+        result.num_of_allocs += dstr_get_num_of_allocs() - allocs_before;
+        result.num_of_ops += batch_size;
+
+        if (copies != NULL)
+        {
+            for (size_t i = 0; i < batch_size; i++)
+            {
+                dstr_free(&copies[i]);
+            }
+
+            free(copies);
+        }
+
+        if (batch_size < max_batch_size)
+        {
+            batch_size = (batch_size * 2 > max_batch_size) ? max_batch_size : batch_size * 2;
+        }
+    }
+
+    return result;
+}
+
+static void print_result(FILE *out, bool is_json, bool is_first, const char *name,
+                         bench_input_t *input, bench_result_t *result)
+{
+    double ns_per_op = result->total_ns / (double)result->num_of_ops;
+    double bytes_per_sec = ((double)input->size * (double)result->num_of_ops) / (result->total_ns / NS_PER_SEC);
+    double allocs_per_op = (double)result->num_of_allocs / (double)result->num_of_ops;
+
+    if (is_json)
+    {
+        fprintf(out, "%s\n  {\"name\": \"%s\", \"variant\": \"%s\", \"size\": %zu, \"ops\": %zu, "
+                "\"ns_per_op\": %.2f, \"bytes_per_sec\": %.0f, \"allocs_per_op\": %.2f}",
+                is_first ? "" : ",", name, get_variant_name(input->variant), input->size,
+                result->num_of_ops, ns_per_op, bytes_per_sec, allocs_per_op);
+    }
+    else
+    {
+        fprintf(out, "%s,%s,%zu,%zu,%.2f,%.0f,%.2f\n", name, get_variant_name(input->variant),
+                input->size, result->num_of_ops, ns_per_op, bytes_per_sec, allocs_per_op);
+    }
+
+    fflush(out);
+}
+
+// Accepts plain byte counts or a K, M or G suffix.
+static size_t parse_size(const char *data)
+{
+    char *suffix = NULL;
+    size_t size = (size_t)strtoull(data, &suffix, 10);
+
+    switch (*suffix)
+    {
+        case 'K':
+            return size << 10;
+        case 'M':
+            return size << 20;
+        case 'G':
+            return size << 30;
+        default:
+            return size;
+    }
+}
+
+static void print_usage(const char *program_name)
+{
+    fprintf(stderr, "usage: %s [--json] [--max-size BYTES[K|M|G]] [--filter NAME]\n", program_name);
+}
+
+int main(int argc, char **argv)
+{
+    bool is_json = false;
+    bool is_first = true;
+    size_t max_size = DEFAULT_MAX_SIZE;
+    const char *filter = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            is_json = true;
+        }
+        else if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc)
+        {
+            max_size = parse_size(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Results go to the real stdout, dstring warnings
+    // (like the ones for misses) go to /dev/null.
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    freopen("/dev/null", "w", stdout);
+
+    size_t num_of_cases = sizeof(bench_cases) / sizeof(bench_cases[0]);
+
+    fputs(is_json ? "[" : "name,variant,size,ops,ns_per_op,bytes_per_sec,allocs_per_op\n", out);
+
+    for (size_t size = MIN_SIZE; size <= max_size; size <<= SIZE_STEP_SHIFT)
+    {
+        for (bench_variant_t variant = VARIANT_HIT; variant <= VARIANT_MISS; variant++)
+        {
+            bench_input_t input;
+            setup_input(&input, size, variant);
+
+            for (size_t i = 0; i < num_of_cases; i++)
+            {
+                const bench_case_t *bench_case = &bench_cases[i];
+
+                if ((filter != NULL && strcmp(filter, bench_case->name) != 0)
+                    || (bench_case->is_fixed_size && size != MIN_SIZE)
+                    || (!(bench_case->has_variants) && variant == VARIANT_MISS))
+                {
+                    continue;
+                }
+
+                input.variant = bench_case->has_variants ? variant : VARIANT_NONE;
+
+                bench_result_t result = run_case(bench_case, &input);
+                print_result(out, is_json, is_first, bench_case->name, &input, &result);
+                is_first = false;
+            }
+
+            free_input(&input);
+        }
+    }
+
+    fputs(is_json ? "\n]\n" : "", out);
+    fclose(out);
+
+    return 0;
+}
@@ -1,18 +1,87 @@
+// POSIX 2008 for O_CLOEXEC and the other file and process calls,
+// and _GNU_SOURCE for pipe2, which glibc and musl only declare with it.
+#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+
 #include "dstring.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(DSTR_PROFILE)
+#include <time.h>
+#endif
+
+extern char **environ;
+
 #define PURPLE                      "\033[1;95m"
 #define RED                         "\033[1;91m"
 #define WHITE                       "\033[1;97m"
 #define RESET                       "\033[0m"
 
 #define DEFAULT_CAPACITY            32
-#define STR_MAX_CHARS               100000
+#define UTF8_INDEX_STRIDE           64
+#define UTF8_REPLACEMENT_CHAR       0xFFFD
+#define METRICS_PUBLISH_BYTES       65536
+#define PARALLEL_MIN_CHUNK_SIZE     (1 << 20)
+#define PARALLEL_CANCEL_BLOCK_SIZE  (1 << 18)
+#define FOR_EACH_GRAIN_SIZE         16
+#define MAP_GROUP_SIZE              16
+#define MAP_EMPTY                   ((int8_t)-128)
+#define MAP_DELETED                 ((int8_t)-2)
+#define SORT_INSERTION_SIZE         16
+#define PARALLEL_SORT_MIN_SIZE      (1 << 16)
+#define WRITER_BUFFER_SIZE          65536
+#define WRITER_MAX_IOVECS           1024
+#define PROC_MAX_RUNNING            64
+#define PROC_READ_SIZE              65536
+#define PROC_MIN_READ_SIZE          4096
+#define SNAPSHOT_MAGIC              "DSTRSNAP"
+#define SNAPSHOT_VERSION            2
+#define SNAPSHOT_BYTE_ORDER         0x01020304
+#define TRANS_MAX_SIMD_BYTES        8
+#define CRC32C_POLYNOMIAL           0x82F63B78
+#define DIGEST_STRIPE_SIZE          32
+#define CSV_BLOCK_SIZE              64
+#define CSV_BUFFER_SIZE             65536
+#define SPLIT_MAX_SIMD_BYTES        8
+
+// Sparse codepoint index, one byte offset for every
+// UTF8_INDEX_STRIDE codepoints. offsets is NULL when
+// the str is all ASCII, since then offset == index.
+typedef struct utf8_index
+{
+    size_t length;
+    size_t size;
+    size_t *offsets;
+} utf8_index_t;
 
 typedef struct dstr
 {
     size_t size;
     size_t capacity;
     char *data;
+    utf8_index_t *utf8_index;
+    uint64_t hash;
+    bool is_hash_cached;
 } dstr_t;
 
 typedef struct dstr_arr
@@ -21,1583 +90,9406 @@ typedef struct dstr_arr
     dstr_t **data_set;
 } dstr_arr_t;
 
-static bool is_dstr_null(dstr_t *dstr, const char *func_name)
+typedef struct dstr_index_arr
 {
-    if (dstr == NULL)
-    {
-        printf("%s: %swarning:%s dstr is NULL%s\n", func_name, PURPLE, WHITE, RESET);
-        return true;
-    }
+    size_t size;
+    size_t capacity;
+    size_t *data;
+} dstr_index_arr_t;
 
-    return false;
-}
+// A run of the pattern between two '*'. is_any marks the '?' positions.
+// shift is the Horspool bad character table, '?' matches every byte
+// so it caps the shift for all of them.
+typedef struct glob_segment
+{
+    size_t size;
+    char *data;
+    bool *is_any;
+    size_t shift[256];
+} glob_segment_t;
+
+// segments[0] is the part before the first '*' and segments[size-1] the
+// part after the last one. Both may be empty. Without a '*' there is
+// exactly one segment that has to match the whole str.
+typedef struct dstr_glob
+{
+    bool has_star;
+    size_t min_size;
+    size_t size;
+    glob_segment_t *segments;
+} dstr_glob_t;
 
-static bool is_str_null(const char *data, const char *func_name)
+// Open addressing with linear probing. Empty slots have a NULL dstr,
+// and hashes are kept next to them so probing rarely touches the data.
+typedef struct intern_slot
 {
-    bool is_null = (data == NULL);
+    uint64_t hash;
+    dstr_t *dstr;
+} intern_slot_t;
 
-    if (is_null)
-    {
-        printf("%s: %swarning:%s string literal input is NULL%s\n", func_name, PURPLE, WHITE, RESET);
-    }
+typedef struct dstr_intern
+{
+    size_t size;
+    size_t capacity;
+    intern_slot_t *slots;
+} dstr_intern_t;
 
-    return is_null;
-}
+// The next 8 bytes of the key from the current depth, big endian and zero
+// padded, so comparing prefixes compares bytes and most comparisons never
+// touch the dstr. index is the original position, for the stable sort.
+typedef struct sort_entry
+{
+    uint64_t prefix;
+    dstr_t *dstr;
+    size_t index;
+} sort_entry_t;
 
-static bool is_not_valid_str(const char *data, const char *func_name)
+typedef struct sort_bucket
 {
-    bool is_valid_str = ((data != NULL) && (data[0] != '\0'));
+    sort_entry_t *entries;
+    size_t size;
+    bool is_stable;
+} sort_bucket_t;
 
-    if (!(is_valid_str))
-    {
-        printf("%s: %swarning:%s string literal input is not a valid string%s\n", func_name, PURPLE, WHITE, RESET);
-    }
+// Small writes are copied into buffer, and anything at least half its
+// size is written straight from the caller's memory together with it.
+typedef struct dstr_writer
+{
+    int fd;
+    bool is_failed;
+    size_t size;
+    size_t capacity;
+    char *buffer;
+} dstr_writer_t;
 
-    return !(is_valid_str);
+typedef struct map_slot
+{
+    dstr_t *key;
+    void *value;
+} map_slot_t;
+
+// Swiss table layout. The slots are split into groups of MAP_GROUP_SIZE,
+// and each slot has a control byte that is MAP_EMPTY, MAP_DELETED, or the
+// low 7 bits of the key's hash. A lookup checks a whole group of control
+// bytes at once and only compares keys whose 7 bits match. The rest of
+// the hash picks the first group, and groups are probed triangularly.
+typedef struct dstr_map
+{
+    size_t size;
+    size_t num_of_deleted;
+    size_t capacity;
+    int8_t *control;
+    map_slot_t *slots;
+} dstr_map_t;
+
+// Snapshot file layout, all in native byte order:
+// the header, then num_of_elements + 1 uint64_t offsets into the blob,
+// then the blob with every element followed by a '\0'. Element i is
+// blob[offsets[i]] to blob[offsets[i + 1] - 1], and the checksum is
+// the crc32c of the offsets and the blob together.
+typedef struct snapshot_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t num_of_elements;
+    uint64_t blob_size;
+    uint64_t checksum;
+} snapshot_header_t;
+
+// An opened snapshot is the mapped file itself, the views point into it.
+typedef struct dstr_snapshot
+{
+    char *map;
+    size_t map_size;
+    size_t size;
+    size_t blob_size;
+    uint64_t checksum;
+    const uint64_t *offsets;
+    const char *blob;
+} dstr_snapshot_t;
+
+// Byte mapping from dstr_maketrans. When only a few bytes change, they are
+// also listed in from, to and deleted so dstr_translate can match them
+// with SIMD compares instead of looking up every byte in map.
+typedef struct dstr_trans
+{
+    unsigned char map[256];
+    bool is_deleted[256];
+    size_t num_of_pairs;
+    size_t num_of_deleted;
+    unsigned char from[TRANS_MAX_SIMD_BYTES];
+    unsigned char to[TRANS_MAX_SIMD_BYTES];
+    unsigned char deleted[TRANS_MAX_SIMD_BYTES];
+} dstr_trans_t;
+
+// Bounds of a field as it is in the data, quotes included.
+typedef struct csv_field
+{
+    size_t start;
+    size_t end;
+} csv_field_t;
+
+// A record is parsed in two stages. The first finds the delimiters and
+// newlines outside of quotes, CSV_BLOCK_SIZE bytes at a time as bitmasks,
+// and the second turns the fields between them into views. data is the
+// caller's memory, or buffer's data when reading a stream. The block at
+// block_start keeps the ends not used yet, so a block is classified once
+// however many records start in it.
+typedef struct dstr_csv_reader
+{
+    char delimiter;
+    FILE *fp;
+    bool is_eof;
+    const char *data;
+    size_t size;
+    size_t position;
+    size_t block_start;
+    size_t next_block_start;
+    uint64_t block_ends;
+    uint64_t in_quote;
+    dstr_t *buffer;
+    dstr_t *scratch;
+    size_t num_of_fields;
+    size_t fields_capacity;
+    csv_field_t *raw_fields;
+    dstr_view_t *fields;
+} dstr_csv_reader_t;
+
+// The bytes a str is split on. The SIMD path compares against whitespace
+// ranges or up to SPLIT_MAX_SIMD_BYTES bytes, bigger sets use the table.
+typedef struct split_set
+{
+    bool is_member[256];
+    bool is_whitespace;
+    size_t num_of_bytes;
+    unsigned char bytes[SPLIT_MAX_SIMD_BYTES];
+} split_set_t;
+
+// Fields are added to data_set as they are found, and it is shrunk to size
+// at the end, so dstr_arr_free sees the usual size.
+typedef struct split_builder
+{
+    dstr_arr_t *dstr_array;
+    size_t capacity;
+} split_builder_t;
+
+typedef enum escape_style
+{
+    ESCAPE_JSON,
+    ESCAPE_C,
+    ESCAPE_SHELL
+} escape_style_t;
+
+// Streaming XXH64 state. Input is taken in stripes of DIGEST_STRIPE_SIZE
+// bytes, and whatever doesn't fill a stripe waits in buffer.
+typedef struct dstr_digest
+{
+    uint64_t seed;
+    uint64_t accumulators[4];
+    uint64_t total_size;
+    size_t buffer_size;
+    unsigned char buffer[DIGEST_STRIPE_SIZE];
+} dstr_digest_t;
+
+#if defined(DSTR_PROFILE)
+
+#define PROFILE_MAX_FUNCS           256
+#define PROFILE_OTHERS_NAME         "(others)"
+
+// Counters are only written by the thread that owns them
+// and read by whoever merges the shards.
+typedef struct profile_counter
+{
+    _Atomic uint64_t calls;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t reallocs;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t histogram[DSTR_PROFILE_NUM_OF_BUCKETS];
+} profile_counter_t;
+
+typedef struct profile_shard
+{
+    profile_counter_t counters[PROFILE_MAX_FUNCS];
+    struct profile_shard *next;
+} profile_shard_t;
+
+typedef struct profile_scope
+{
+    profile_counter_t *counter;
+    profile_counter_t *prev_counter;
+    uint64_t start_ns;
+} profile_scope_t;
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *profile_names[PROFILE_MAX_FUNCS];
+static _Atomic size_t num_of_profiled = 0;
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+static pthread_key_t profile_key;
+static profile_shard_t *profile_shards = NULL;
+// Totals of the shards of threads that have exited.
+static profile_shard_t retired_profile;
+static _Thread_local profile_shard_t *profile_shard = NULL;
+static _Thread_local profile_counter_t *profile_current = NULL;
+
+static void add_to_counter(_Atomic uint64_t *counter, uint64_t value)
+{
+    // Single writer, so this doesn't need a locked add.
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
 }
 
-static bool is_dstr_arr_null(dstr_arr_t *dstr_array, const char *func_name)
+static uint64_t get_profile_ns(void)
 {
-    bool is_null = (dstr_array == NULL);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-    if (is_null)
+    return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+}
+
+// Each profiled function gets a slot the first time it runs.
+// profile_id is 1-based so 0 means it has no slot yet.
+static size_t get_profile_slot(_Atomic size_t *profile_id, const char *func_name)
+{
+    size_t id = atomic_load_explicit(profile_id, memory_order_acquire);
+
+    if (id != 0)
     {
-        printf("%s: %swarning:%s dstr_arr is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+        return id - 1;
     }
 
-    return is_null;
-}
+    pthread_mutex_lock(&profile_lock);
 
-static bool is_size_zero(size_t size, const char *func_name)
-{
-    bool is_valid_size = (size == 0);
+    id = atomic_load_explicit(profile_id, memory_order_relaxed);
 
-    if (is_valid_size)
+    if (id == 0)
     {
-        printf("%s: %swarning:%s size is equal to zero%s\n", func_name, PURPLE, WHITE, RESET);
+        size_t slot = atomic_load_explicit(&num_of_profiled, memory_order_relaxed);
+
+        // The last slot is shared by every function past the limit. The
+        // warning is only printed when it fills up, and profile_id keeps
+        // the shared slot too, so those functions don't take the lock again.
+        if (slot >= PROFILE_MAX_FUNCS - 1)
+        {
+            if (slot == PROFILE_MAX_FUNCS - 1)
+            {
+                printf("%s: %swarning:%s too many profiled functions, the rest are counted as %s%s\n",
+                       func_name, PURPLE, WHITE, PROFILE_OTHERS_NAME, RESET);
+                profile_names[slot] = PROFILE_OTHERS_NAME;
+                atomic_store_explicit(&num_of_profiled, PROFILE_MAX_FUNCS, memory_order_release);
+            }
+
+            slot = PROFILE_MAX_FUNCS - 1;
+        }
+        else
+        {
+            profile_names[slot] = func_name;
+            atomic_store_explicit(&num_of_profiled, slot + 1, memory_order_release);
+        }
+
+        id = slot + 1;
+        atomic_store_explicit(profile_id, id, memory_order_release);
     }
 
-    return is_valid_size;
+    pthread_mutex_unlock(&profile_lock);
+
+    return id - 1;
 }
 
-static bool is_pointer_null(void *data, const char *func_name)
+static void add_profile_counter(profile_counter_t *total, profile_counter_t *counter)
 {
-    bool is_not_valid_pointer = (data == NULL);
+    add_to_counter(&total->calls, atomic_load_explicit(&counter->calls, memory_order_relaxed));
+    add_to_counter(&total->bytes, atomic_load_explicit(&counter->bytes, memory_order_relaxed));
+    add_to_counter(&total->reallocs, atomic_load_explicit(&counter->reallocs, memory_order_relaxed));
+    add_to_counter(&total->total_ns, atomic_load_explicit(&counter->total_ns, memory_order_relaxed));
 
-    if (is_not_valid_pointer)
+    for (size_t i = 0; i < DSTR_PROFILE_NUM_OF_BUCKETS; i++)
     {
-        printf("%s: %swarning:%s pointer input is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+        add_to_counter(&total->histogram[i], atomic_load_explicit(&counter->histogram[i], memory_order_relaxed));
     }
-
-    return is_not_valid_pointer;
 }
 
-static bool check_index(int64_t *index, size_t size, const char *func_name)
+static void retire_profile_shard(void *data)
 {
-    int64_t index_copy = *index;
+    profile_shard_t *shard = data;
+    profile_shard_t **link = &profile_shards;
 
-    if (*index < 0)
+    pthread_mutex_lock(&profile_lock);
+
+    while (*link != shard)
     {
-        *index += size;
+        link = &(*link)->next;
     }
 
-    if (*index < 0 || *index >= (int64_t)size)
+    *link = shard->next;
+
+    for (size_t i = 0; i < PROFILE_MAX_FUNCS; i++)
     {
-        printf("%s: %swarning:%s index %lld is out of range%s\n", func_name, PURPLE, WHITE, index_copy, RESET);
-        return true;
+        add_profile_counter(&retired_profile.counters[i], &shard->counters[i]);
     }
 
-    return false;
+    pthread_mutex_unlock(&profile_lock);
+
+    // Same as the metrics shards, a later thread-local destructor
+    // that calls into dstring gets a new shard.
+    profile_shard = NULL;
+    profile_current = NULL;
+    free(shard);
 }
 
-static bool check_ranges(int64_t *start, int64_t *end, size_t size, const char *func_name)
+static void setup_profile_key(void)
 {
-    int64_t size_copy = (int64_t)size;
+    pthread_key_create(&profile_key, retire_profile_shard);
+}
 
-    if (*start >= size_copy || *end > size_copy)
+// Returns NULL when the shard can't be allocated,
+// and the call just goes uncounted.
+static profile_shard_t *get_profile_shard(void)
+{
+    if (profile_shard == NULL)
     {
-        printf("%s: %swarning:%s indices are out of range%s\n", func_name, PURPLE, WHITE, RESET);
-        return true;
-    }
+        pthread_once(&profile_once, setup_profile_key);
 
-    if (*start < 0)
-    {
-        *start += size;
-    }
+        profile_shard = calloc(1, sizeof(profile_shard_t));
 
-    if (*end == 0)
-    {
-        *end = size_copy;
-    }
-    else if (*end < 0)
-    {
-        *end += size_copy;
-    }
+        if (profile_shard == NULL)
+        {
+            return NULL;
+        }
 
-    if (*start < 0 || *end > size_copy || (*end - *start) <= 0)
-    {
-        printf("%s: %swarning:%s indices are out of range%s\n", func_name, PURPLE, WHITE, RESET);
-        return true;
+        pthread_setspecific(profile_key, profile_shard);
+
+        pthread_mutex_lock(&profile_lock);
+        profile_shard->next = profile_shards;
+        profile_shards = profile_shard;
+        pthread_mutex_unlock(&profile_lock);
     }
 
-    return false;
+    return profile_shard;
 }
 
-// Separates a str with a multi-character delimiter.
-static char *strsep_chars(char **data, const char *separator) 
+static profile_scope_t begin_profile_scope(_Atomic size_t *profile_id, const char *func_name, size_t bytes)
 {
-    if (*data == NULL)
-    {
-        return *data;
-    }
+    profile_scope_t scope;
+    profile_shard_t *shard = get_profile_shard();
+    size_t slot = get_profile_slot(profile_id, func_name);
 
-    char *end = strstr(*data, separator);
-    char *temp = *data;
+    scope.prev_counter = profile_current;
+    scope.counter = NULL;
+    scope.start_ns = 0;
 
-    if (end == NULL)
+    if (shard == NULL)
     {
-        *data = NULL;
-        return temp;
+        return scope;
     }
 
-    *end = '\0';
-    *data = end + strlen(separator);
+    scope.counter = &shard->counters[slot];
+    profile_current = scope.counter;
 
-    return temp;
+    add_to_counter(&scope.counter->calls, 1);
+    add_to_counter(&scope.counter->bytes, bytes);
+    scope.start_ns = get_profile_ns();
+
+    return scope;
 }
 
-static int64_t get_start_index(int64_t *start_opt, size_t size, bool is_step_neg)
+// Bucket i counts the calls that took [2^i, 2^(i+1)) ns, the last one everything above.
+static void end_profile_scope(profile_scope_t *scope)
 {
-    int64_t size_cast = (int64_t)size;
-
-    if (start_opt == NULL)
+    if (scope->counter == NULL)
     {
-        return is_step_neg ? (size_cast - 1) : 0;
+        return;
     }
 
-    int64_t start = *start_opt;
+    uint64_t elapsed_ns = get_profile_ns() - scope->start_ns;
+    size_t bucket = 63 - (size_t)__builtin_clzll(elapsed_ns | 1);
 
-    if (start >= size_cast)
+    if (bucket >= DSTR_PROFILE_NUM_OF_BUCKETS)
     {
-        return is_step_neg ? (size_cast - 1) : size_cast;
+        bucket = DSTR_PROFILE_NUM_OF_BUCKETS - 1;
     }
 
-    // If start is negative, then add the size of str to start.
-    // So if start == -3 and the size is 10, 
-    // you will start at 7.
-    if (start < 0)
-    {
-        start += size_cast;
-    }
+    add_to_counter(&scope->counter->total_ns, elapsed_ns);
+    add_to_counter(&scope->counter->histogram[bucket], 1);
+    profile_current = scope->prev_counter;
+}
 
-    if (start >= size_cast)
-    {
-        // Returning -1 here means something went wrong.
-        // I can't set it to zero, so -1 it is. This will get checked in get_sub_size.
-        // This is a little bit confusing cause in get_end_index,
-        // return -1 is actually something we want to happen and is a good thing.
-        return -1;
-    }
+#define PROFILE_FUNC(bytes) \
+    static _Atomic size_t profile_id = 0; \
+    profile_scope_t profile_scope __attribute__((cleanup(end_profile_scope))) = begin_profile_scope(&profile_id, __func__, (size_t)(bytes))
 
-    // If the start value is less than the size of the str,
-    // return 0. This might be the case if the start value is a
-    // a negative number even after the size has been added to it.
-    if (start < 0 && start < size_cast)
-    {
-        return 0;
-    }
+#define PROFILE_REALLOC() \
+    if (profile_current != NULL) add_to_counter(&profile_current->reallocs, 1)
 
-    return start;
+#else
+
+#define PROFILE_FUNC(bytes)
+#define PROFILE_REALLOC()
+
+#endif
+
+// Allocation accounting. Every thread counts into its own shard, which only
+// that thread writes, and dstr_metrics_snapshot sums them up. Memory freed by
+// another thread than the one that allocated it just makes one shard go
+// negative. The peak can't be summed up later, so each shard publishes its
+// bytes to published_bytes in METRICS_PUBLISH_BYTES steps, which keeps
+// the peak within METRICS_PUBLISH_BYTES per thread.
+typedef struct metrics_shard
+{
+    _Atomic int64_t num_of_allocs;
+    _Atomic int64_t bytes;
+    _Atomic int64_t num_of_dstrs;
+    _Atomic int64_t dstr_capacity_bytes;
+    _Atomic int64_t dstr_size_bytes;
+    int64_t unpublished_bytes;
+    struct metrics_shard *next;
+} metrics_shard_t;
+
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+static pthread_key_t metrics_key;
+static metrics_shard_t *metrics_shards = NULL;
+// Totals of the shards of threads that have exited.
+static metrics_shard_t retired_metrics;
+static _Atomic int64_t published_bytes = 0;
+static _Atomic int64_t peak_bytes = 0;
+static _Thread_local metrics_shard_t *metrics_shard = NULL;
+
+static void add_to_metric(_Atomic int64_t *metric, int64_t value)
+{
+    // Single writer, so this doesn't need a locked add.
+    atomic_store_explicit(metric, atomic_load_explicit(metric, memory_order_relaxed) + value, memory_order_relaxed);
 }
 
-static int64_t get_end_index(int64_t *end_opt, size_t size, bool is_step_neg, int64_t start)
+static void update_peak_bytes(int64_t bytes)
 {
-    int64_t size_cast = (int64_t)size;
+    int64_t peak = atomic_load_explicit(&peak_bytes, memory_order_relaxed);
 
-    if (end_opt == NULL)
+    while (bytes > peak
+        && !(atomic_compare_exchange_weak_explicit(&peak_bytes, &peak, bytes, memory_order_relaxed, memory_order_relaxed)))
     {
-        // If you are going through each index in the string,
-        // you need to get str[0] too so we have to return -1.
-        if (is_step_neg)
-        {
-            return (start == 0) ? 0 : -1;
-        }
-        else
-        {
-            return size_cast;
-        }
     }
+}
 
-    int64_t end = *end_opt;
+static void retire_metrics_shard(void *data)
+{
+    metrics_shard_t *shard = data;
+    metrics_shard_t **link = &metrics_shards;
 
-    // If end is negative, then add the size of str to end.
-    // So if end == -1 and the size is 10, 
-    // you will get 9, the last index of your str.
-    if (end < 0)
-    {
-        end += size_cast;
-    }
+    pthread_mutex_lock(&metrics_lock);
 
-    // If the end value is larger than the size of the str,
-    // set end to the size of str.
-    if (end > size_cast)
+    while (*link != shard)
     {
-        end = size_cast;
+        link = &(*link)->next;
     }
 
-    // If the end value is less than the size of the str,
-    // return -1. This might be the case if the end value is a
-    // a negative number even after the size has been added to it.
-    if (end < 0 && end < size_cast)
-    {
-        return -1;
-    }
+    *link = shard->next;
 
-    return end;
+    add_to_metric(&retired_metrics.num_of_allocs, atomic_load(&shard->num_of_allocs));
+    add_to_metric(&retired_metrics.bytes, atomic_load(&shard->bytes));
+    add_to_metric(&retired_metrics.num_of_dstrs, atomic_load(&shard->num_of_dstrs));
+    add_to_metric(&retired_metrics.dstr_capacity_bytes, atomic_load(&shard->dstr_capacity_bytes));
+    add_to_metric(&retired_metrics.dstr_size_bytes, atomic_load(&shard->dstr_size_bytes));
+    atomic_fetch_add_explicit(&published_bytes, shard->unpublished_bytes, memory_order_relaxed);
+
+    pthread_mutex_unlock(&metrics_lock);
+
+    // Runs on the exiting thread. Other thread-local destructors may still
+    // use dstring after this, and get a new shard that is retired the same way.
+    metrics_shard = NULL;
+    free(shard);
 }
 
-static size_t get_sub_size(int64_t start, int64_t end, bool is_step_neg)
+static void setup_metrics_key(void)
 {
-    if (start < 0)
+    pthread_key_create(&metrics_key, retire_metrics_shard);
+}
+
+static metrics_shard_t *get_metrics_shard(void)
+{
+    if (metrics_shard == NULL)
     {
-        return 0;
-    }
+        pthread_once(&metrics_once, setup_metrics_key);
 
-    size_t sub_str_size = is_step_neg ? (size_t)(start - end) : (size_t)(end - start);
+        metrics_shard = calloc(1, sizeof(metrics_shard_t));
+        pthread_setspecific(metrics_key, metrics_shard);
 
-    if (sub_str_size == 0)
-    {
-        return 0;
+        pthread_mutex_lock(&metrics_lock);
+        metrics_shard->next = metrics_shards;
+        metrics_shards = metrics_shard;
+        pthread_mutex_unlock(&metrics_lock);
     }
 
-    return sub_str_size;
+    return metrics_shard;
 }
 
-static size_t ceil_lu(size_t x, size_t y) 
+static void add_allocated_bytes(int64_t bytes)
 {
-    return (size_t)ceil(x / (double)y);
-}
+    metrics_shard_t *shard = get_metrics_shard();
 
-static size_t count_occurrences_in_str(const char *data, const char *search_val, size_t count, size_t start, size_t end)
-{
-    if (*search_val == '\0')
+    add_to_metric(&shard->bytes, bytes);
+    shard->unpublished_bytes += bytes;
+
+    if (shard->unpublished_bytes >= METRICS_PUBLISH_BYTES || shard->unpublished_bytes <= -METRICS_PUBLISH_BYTES)
     {
-        return 0;
+        int64_t total = atomic_fetch_add_explicit(&published_bytes, shard->unpublished_bytes, memory_order_relaxed);
+
+        update_peak_bytes(total + shard->unpublished_bytes);
+        shard->unpublished_bytes = 0;
     }
+}
 
-    size_t data_size = strlen(data);
-    char *data_alloc = strdup(data);
-    char *data_copy = data_alloc;
+// Every allocation goes through these so the accounting stays per thread.
+static void *mem_alloc(size_t size)
+{
+    add_to_metric(&get_metrics_shard()->num_of_allocs, 1);
+    add_allocated_bytes((int64_t)size);
 
-    add_to_allocated(sizeof(char) * (data_size + 1));
+    return malloc(size);
+}
 
-    data_copy = &data_copy[start];
-    data_copy[end-start] = '\0';
+static void *mem_realloc(void *data, size_t old_size, size_t new_size)
+{
+    PROFILE_REALLOC();
+    add_to_metric(&get_metrics_shard()->num_of_allocs, 1);
+    add_allocated_bytes((int64_t)new_size - (int64_t)old_size);
 
-    size_t occurrences = 0;
-    size_t search_val_size = strlen(search_val);
-    data_copy = strstr(data_copy, search_val);
+    return realloc(data, new_size);
+}
+
+static void mem_free(void *data, size_t size)
+{
+    add_allocated_bytes(-(int64_t)size);
+    free(data);
+}
+
+// For memory allocated outside of mem_alloc, like strdup.
+static void add_allocation(size_t size)
+{
+    add_to_metric(&get_metrics_shard()->num_of_allocs, 1);
+    add_allocated_bytes((int64_t)size);
+}
+
+// The dstr_t structs and their data go through these,
+// so the live dstr count and capacity slack stay up to date.
+static dstr_t *alloc_dstr(void)
+{
+    dstr_t *dstr = mem_alloc(sizeof(dstr_t));
+
+    dstr->size = 0;
+    dstr->capacity = 0;
+    dstr->data = NULL;
+    dstr->utf8_index = NULL;
+    dstr->hash = 0;
+    dstr->is_hash_cached = false;
+    add_to_metric(&get_metrics_shard()->num_of_dstrs, 1);
+
+    return dstr;
+}
+
+static void free_dstr(dstr_t *dstr)
+{
+    add_to_metric(&get_metrics_shard()->num_of_dstrs, -1);
+    mem_free(dstr, sizeof(dstr_t));
+}
+
+static void set_dstr_size(dstr_t *dstr, size_t size)
+{
+    add_to_metric(&get_metrics_shard()->dstr_size_bytes, (int64_t)size - (int64_t)dstr->size);
+    dstr->size = size;
+}
+
+// Replaces the data of a dstr with a new buffer that holds capacity chars.
+static void set_dstr_data(dstr_t *dstr, char *data, size_t capacity)
+{
+    add_to_metric(&get_metrics_shard()->dstr_capacity_bytes, (int64_t)capacity - (int64_t)dstr->capacity);
+    dstr->data = data;
+    dstr->capacity = capacity;
+}
+
+static char *alloc_dstr_data(size_t capacity)
+{
+    return mem_alloc(sizeof(char) * (capacity + 1));
+}
+
+static bool is_dstr_null(dstr_t *dstr, const char *func_name)
+{
+    if (dstr == NULL)
+    {
+        printf("%s: %swarning:%s dstr is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+        return true;
+    }
+
+    return false;
+}
+
+static bool is_str_null(const char *data, const char *func_name)
+{
+    bool is_null = (data == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s string literal input is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_not_valid_str(const char *data, const char *func_name)
+{
+    bool is_valid_str = ((data != NULL) && (data[0] != '\0'));
+
+    if (!(is_valid_str))
+    {
+        printf("%s: %swarning:%s string literal input is not a valid string%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return !(is_valid_str);
+}
+
+static bool is_dstr_arr_null(dstr_arr_t *dstr_array, const char *func_name)
+{
+    bool is_null = (dstr_array == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s dstr_arr is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_index_arr_null(dstr_index_arr_t *index_array, const char *func_name)
+{
+    bool is_null = (index_array == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s index_arr is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_glob_null(dstr_glob_t *glob, const char *func_name)
+{
+    bool is_null = (glob == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s glob is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_intern_null(dstr_intern_t *intern, const char *func_name)
+{
+    bool is_null = (intern == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s intern table is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_map_null(dstr_map_t *map, const char *func_name)
+{
+    bool is_null = (map == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s map is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_writer_null(dstr_writer_t *writer, const char *func_name)
+{
+    bool is_null = (writer == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s writer is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_snapshot_null(dstr_snapshot_t *snapshot, const char *func_name)
+{
+    bool is_null = (snapshot == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s snapshot is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_trans_null(dstr_trans_t *trans, const char *func_name)
+{
+    bool is_null = (trans == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s trans is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_digest_null(dstr_digest_t *digest, const char *func_name)
+{
+    bool is_null = (digest == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s digest is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_csv_reader_null(dstr_csv_reader_t *reader, const char *func_name)
+{
+    bool is_null = (reader == NULL);
+
+    if (is_null)
+    {
+        printf("%s: %swarning:%s reader is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_null;
+}
+
+static bool is_size_zero(size_t size, const char *func_name)
+{
+    bool is_valid_size = (size == 0);
+
+    if (is_valid_size)
+    {
+        printf("%s: %swarning:%s size is equal to zero%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_valid_size;
+}
+
+static bool is_pointer_null(void *data, const char *func_name)
+{
+    bool is_not_valid_pointer = (data == NULL);
+
+    if (is_not_valid_pointer)
+    {
+        printf("%s: %swarning:%s pointer input is NULL%s\n", func_name, PURPLE, WHITE, RESET);
+    }
+
+    return is_not_valid_pointer;
+}
+
+static bool check_index(int64_t *index, size_t size, const char *func_name)
+{
+    int64_t index_copy = *index;
+
+    if (*index < 0)
+    {
+        *index += size;
+    }
+
+    if (*index < 0 || *index >= (int64_t)size)
+    {
+        printf("%s: %swarning:%s index %lld is out of range%s\n", func_name, PURPLE, WHITE, index_copy, RESET);
+        return true;
+    }
+
+    return false;
+}
+
+static bool check_ranges(int64_t *start, int64_t *end, size_t size, const char *func_name)
+{
+    int64_t size_copy = (int64_t)size;
+
+    if (*start >= size_copy || *end > size_copy)
+    {
+        printf("%s: %swarning:%s indices are out of range%s\n", func_name, PURPLE, WHITE, RESET);
+        return true;
+    }
+
+    if (*start < 0)
+    {
+        *start += size;
+    }
+
+    if (*end == 0)
+    {
+        *end = size_copy;
+    }
+    else if (*end < 0)
+    {
+        *end += size_copy;
+    }
+
+    if (*start < 0 || *end > size_copy || (*end - *start) <= 0)
+    {
+        printf("%s: %swarning:%s indices are out of range%s\n", func_name, PURPLE, WHITE, RESET);
+        return true;
+    }
+
+    return false;
+}
+
+// Separates a str with a multi-character delimiter.
+static char *strsep_chars(char **data, const char *separator) 
+{
+    if (*data == NULL)
+    {
+        return *data;
+    }
+
+    char *end = strstr(*data, separator);
+    char *temp = *data;
+
+    if (end == NULL)
+    {
+        *data = NULL;
+        return temp;
+    }
+
+    *end = '\0';
+    *data = end + strlen(separator);
+
+    return temp;
+}
+
+static int64_t get_start_index(int64_t *start_opt, size_t size, bool is_step_neg)
+{
+    int64_t size_cast = (int64_t)size;
+
+    if (start_opt == NULL)
+    {
+        return is_step_neg ? (size_cast - 1) : 0;
+    }
+
+    int64_t start = *start_opt;
+
+    if (start >= size_cast)
+    {
+        return is_step_neg ? (size_cast - 1) : size_cast;
+    }
+
+    // If start is negative, then add the size of str to start.
+    // So if start == -3 and the size is 10, 
+    // you will start at 7.
+    if (start < 0)
+    {
+        start += size_cast;
+    }
+
+    if (start >= size_cast)
+    {
+        // Returning -1 here means something went wrong.
+        // I can't set it to zero, so -1 it is. This will get checked in get_sub_size.
+        // This is a little bit confusing cause in get_end_index,
+        // return -1 is actually something we want to happen and is a good thing.
+        return -1;
+    }
+
+    // If the start value is less than the size of the str,
+    // return 0. This might be the case if the start value is a
+    // a negative number even after the size has been added to it.
+    if (start < 0 && start < size_cast)
+    {
+        return 0;
+    }
+
+    return start;
+}
+
+static int64_t get_end_index(int64_t *end_opt, size_t size, bool is_step_neg, int64_t start)
+{
+    int64_t size_cast = (int64_t)size;
+
+    if (end_opt == NULL)
+    {
+        // If you are going through each index in the string,
+        // you need to get str[0] too so we have to return -1.
+        if (is_step_neg)
+        {
+            return (start == 0) ? 0 : -1;
+        }
+        else
+        {
+            return size_cast;
+        }
+    }
+
+    int64_t end = *end_opt;
+
+    // If end is negative, then add the size of str to end.
+    // So if end == -1 and the size is 10, 
+    // you will get 9, the last index of your str.
+    if (end < 0)
+    {
+        end += size_cast;
+    }
+
+    // If the end value is larger than the size of the str,
+    // set end to the size of str.
+    if (end > size_cast)
+    {
+        end = size_cast;
+    }
+
+    // If the end value is less than the size of the str,
+    // return -1. This might be the case if the end value is a
+    // a negative number even after the size has been added to it.
+    if (end < 0 && end < size_cast)
+    {
+        return -1;
+    }
+
+    return end;
+}
+
+static size_t get_sub_size(int64_t start, int64_t end, bool is_step_neg)
+{
+    // An end on the wrong side of start, like [5:2] with a positive
+    // step, gives an empty slice rather than a negative size.
+    if (start < 0
+        || (is_step_neg && end >= start)
+        || (!(is_step_neg) && end <= start))
+    {
+        return 0;
+    }
+
+    return is_step_neg ? (size_t)(start - end) : (size_t)(end - start);
+}
+
+static size_t ceil_lu(size_t x, size_t y) 
+{
+    return (size_t)ceil(x / (double)y);
+}
+
+static size_t count_occurrences_in_str(const char *data, const char *search_val, size_t count, size_t start, size_t end)
+{
+    if (*search_val == '\0')
+    {
+        return 0;
+    }
+
+    size_t data_size = strlen(data);
+    char *data_alloc = strdup(data);
+    char *data_copy = data_alloc;
+
+    add_allocation(sizeof(char) * (data_size + 1));
+
+    data_copy = &data_copy[start];
+    data_copy[end-start] = '\0';
+
+    size_t occurrences = 0;
+    size_t search_val_size = strlen(search_val);
+    data_copy = strstr(data_copy, search_val);
+
+    while (data_copy != NULL && occurrences < end)
+    {
+        data_copy += search_val_size;
+        data_copy = strstr(data_copy, search_val);
+        occurrences++;
+    }
+
+    if (count > 0 && count < occurrences)
+    {
+        occurrences = count;
+    }
+
+    mem_free(data_alloc, sizeof(char) * (data_size + 1));
+
+    return occurrences;
+}
+
+static dstr_arr_t *alloc_split_str(const char *data, size_t size, const char *separator, size_t max_split)
+{
+    size_t i = 0;
+    char *data_alloc = strdup(data);
+    char *data_copy = data_alloc;
+    size_t num_of_occurrences = count_occurrences_in_str(data_copy, separator, max_split, 0, size);
+
+    add_allocation(sizeof(char) * (size + 1));
+
+    dstr_arr_t *dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    dstr_array->size = num_of_occurrences + 1;
+    dstr_array->data_set = mem_alloc(dstr_array->size * sizeof(dstr_t*));
+
+    while (i < num_of_occurrences)
+    {
+        dstr_array->data_set[i] = dstr_alloc(strsep_chars(&data_copy, separator));
+        i++;
+    }
+
+    dstr_array->data_set[i] = dstr_alloc(data_copy);
+    mem_free(data_alloc, sizeof(char) * (size + 1));
+
+    return dstr_array;
+}
+
+static size_t update_capacity(size_t size, size_t capacity)
+{
+    while (size > capacity)
+    {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+static size_t calculate_capacity(size_t size)
+{
+    return update_capacity(size, DEFAULT_CAPACITY);
+}
+
+static void set_empty_dstr(dstr_t *dstr)
+{
+    set_dstr_size(dstr, 0);
+    set_dstr_data(dstr, alloc_dstr_data(DEFAULT_CAPACITY), DEFAULT_CAPACITY);
+    dstr->data[0] = '\0';
+}
+
+// Gives a dstr a new buffer that fits size chars.
+static void alloc_dstr_capacity(dstr_t *dstr, size_t size)
+{
+    size_t capacity = calculate_capacity(size);
+
+    set_dstr_data(dstr, alloc_dstr_data(capacity), capacity);
+    set_dstr_size(dstr, size);
+}
+
+static bool get_step(int64_t *step_opt, int64_t *step, const char *func_name)
+{
+    if (step_opt == NULL)
+    {
+        *step = 1;
+    }
+    else if (*step_opt == 0)
+    {
+        printf("%s: %swarning:%s slice step cannot be equal to zero%s\n", func_name, PURPLE, WHITE, RESET);
+        return true;
+    }
+    else
+    {
+        *step = *step_opt;
+    }
+
+    return false;
+}
+
+static dstr_t *alloc_substr(const char *data, size_t data_size, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt, const char *func_name)
+{
+    if (is_size_zero(data_size, func_name))
+    {
+        return NULL;
+    }
+
+    int64_t step = 0;
+
+    if (get_step(step_opt, &step, func_name))
+    {
+        return NULL;
+    }
+
+    bool is_step_neg = (step < 0);
+    int64_t start = get_start_index(start_opt, data_size, is_step_neg);
+    int64_t end = get_end_index(end_opt, data_size, is_step_neg, start);
+    size_t size = get_sub_size(start, end, is_step_neg);
+    dstr_t *dsub_str = alloc_dstr();
+
+    if (size == 0)
+    {
+        set_empty_dstr(dsub_str);
+        return dsub_str;
+    }
+
+    size_t abs_step = (step < 0) ? (size_t)(step * -1) : (size_t)step;
+
+    alloc_dstr_capacity(dsub_str, (abs_step >= size) ? 1 : ceil_lu(size, abs_step));
+
+    for (size_t i = 0; i < dsub_str->size; i++)
+    {
+        dsub_str->data[i] = data[start];
+        start += step;
+    }
+
+    dsub_str->data[dsub_str->size] = '\0';
+
+    return dsub_str;
+}
+
+static char *get_str_number(int8_t number)
+{
+    switch (number)
+    {
+        case 0:
+            return "0";
+        case 1:
+            return "1";
+        case 2:
+            return "2";
+        case 3:
+            return "3";
+        case 4:
+            return "4";
+        case 5:
+            return "5";
+        case 6:
+            return "6";
+        case 7:
+            return "7";
+        case 8:
+            return "8";
+        case 9:
+            return "9";
+    }
+
+    return "";
+}
+
+static size_t dstr_realloc_capacity(dstr_t *dstr, const char *data)
+{
+    size_t data_size = strlen(data);
+    set_dstr_size(dstr, dstr->size + data_size);
+
+    if (dstr->size > dstr->capacity)
+    {
+        size_t capacity = update_capacity(dstr->size, dstr->capacity);
+        set_dstr_data(dstr, mem_realloc(dstr->data, sizeof(char) * (dstr->capacity + 1), sizeof(char) * (capacity + 1)), capacity);
+    }
+
+    return data_size;
+}
+
+static void dstr_data_free(dstr_t *dstr)
+{
+    mem_free(dstr->data, sizeof(char) * (dstr->capacity + 1));
+}
+
+static dstr_t *alloc_setup_capacity(size_t file_size)
+{
+    dstr_t *dstr = alloc_dstr();
+    alloc_dstr_capacity(dstr, file_size);
+
+    return dstr;
+}
+
+// The case functions only touch ASCII letters,
+// so multi-byte UTF-8 sequences are left intact.
+static char ascii_upper(char letter)
+{
+    return (letter >= 'a' && letter <= 'z') ? (char)(letter - ('a' - 'A')) : letter;
+}
+
+static char ascii_lower(char letter)
+{
+    return (letter >= 'A' && letter <= 'Z') ? (char)(letter + ('a' - 'A')) : letter;
+}
+
+// Bytes of a multi-byte UTF-8 sequence count as part of a word.
+static bool is_word_byte(char byte)
+{
+    return ((unsigned char)byte >= 0x80 || isalpha((unsigned char)byte));
+}
+
+static bool is_utf8_continuation(char byte)
+{
+    return (((unsigned char)byte & 0xC0) == 0x80);
+}
+
+// Returns the index of the first non-ASCII byte, or size.
+static size_t skip_ascii(const char *data, size_t size)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    while (i + 16 <= size)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&data[i]);
+
+        if (_mm_movemask_epi8(block) != 0)
+        {
+            break;
+        }
+
+        i += 16;
+    }
+#endif
+
+    while (i < size && (unsigned char)data[i] < 0x80)
+    {
+        i++;
+    }
+
+    return i;
+}
+
+// Returns the length of the valid UTF-8 sequence at data,
+// or 0 if it is malformed (overlong, surrogate, > U+10FFFF or truncated).
+static size_t utf8_sequence_size(const unsigned char *data, size_t size)
+{
+    unsigned char lead = data[0];
+
+    if (lead < 0x80)
+    {
+        return 1;
+    }
+
+    size_t sequence_size = 0;
+    unsigned char lower = 0x80;
+    unsigned char upper = 0xBF;
+
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        sequence_size = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        sequence_size = 3;
+        lower = (lead == 0xE0) ? 0xA0 : lower;
+        upper = (lead == 0xED) ? 0x9F : upper;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        sequence_size = 4;
+        lower = (lead == 0xF0) ? 0x90 : lower;
+        upper = (lead == 0xF4) ? 0x8F : upper;
+    }
+
+    if (sequence_size == 0 || sequence_size > size
+        || data[1] < lower || data[1] > upper)
+    {
+        return 0;
+    }
+
+    for (size_t i = 2; i < sequence_size; i++)
+    {
+        if (!(is_utf8_continuation((char)data[i])))
+        {
+            return 0;
+        }
+    }
+
+    return sequence_size;
+}
+
+static bool is_valid_utf8(const char *data, size_t size)
+{
+    size_t i = 0;
+
+    while (i < size)
+    {
+        i += skip_ascii(&data[i], size - i);
+
+        if (i == size)
+        {
+            break;
+        }
+
+        size_t sequence_size = utf8_sequence_size((const unsigned char*)&data[i], size - i);
+
+        if (sequence_size == 0)
+        {
+            return false;
+        }
+
+        i += sequence_size;
+    }
+
+    return true;
+}
+
+// Every byte that is not a continuation byte starts a codepoint.
+static size_t count_codepoints(const char *data, size_t size)
+{
+    size_t i = 0;
+    size_t length = 0;
+
+#if defined(__SSE2__)
+    // Continuation bytes are 0x80 to 0xBF, which is -128 to -65 signed.
+    const __m128i last_continuation = _mm_set1_epi8((char)0xBF);
+
+    while (i + 16 <= size)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&data[i]);
+        int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(block, last_continuation));
+
+        length += (size_t)__builtin_popcount((unsigned int)mask);
+        i += 16;
+    }
+#endif
+
+    while (i < size)
+    {
+        length += !(is_utf8_continuation(data[i]));
+        i++;
+    }
+
+    return length;
+}
+
+static uint32_t decode_utf8(const char *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    size_t sequence_size = utf8_sequence_size(bytes, size);
+
+    switch (sequence_size)
+    {
+        case 1:
+            return bytes[0];
+        case 2:
+            return ((uint32_t)(bytes[0] & 0x1F) << 6) | (bytes[1] & 0x3F);
+        case 3:
+            return ((uint32_t)(bytes[0] & 0x0F) << 12) | ((uint32_t)(bytes[1] & 0x3F) << 6) | (bytes[2] & 0x3F);
+        case 4:
+            return ((uint32_t)(bytes[0] & 0x07) << 18) | ((uint32_t)(bytes[1] & 0x3F) << 12)
+                | ((uint32_t)(bytes[2] & 0x3F) << 6) | (bytes[3] & 0x3F);
+        default:
+            return UTF8_REPLACEMENT_CHAR;
+    }
+}
+
+static void free_utf8_index(dstr_t *dstr)
+{
+    utf8_index_t *index = dstr->utf8_index;
+
+    if (index == NULL)
+    {
+        return;
+    }
+
+    if (index->offsets != NULL)
+    {
+        mem_free(index->offsets, sizeof(size_t) * index->size);
+    }
+
+    mem_free(index, sizeof(utf8_index_t));
+    dstr->utf8_index = NULL;
+}
+
+// Drops everything cached on the dstr.
+// Has to be called whenever the data of a dstr changes.
+static void invalidate_cached(dstr_t *dstr)
+{
+    free_utf8_index(dstr);
+    dstr->is_hash_cached = false;
+}
+
+// 64-bit multiply and fold, the mixing step of the hash. Done as four
+// 32-bit products where there's no 128-bit type.
+static uint64_t mix_hash(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = (__uint128_t)a * b;
+
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    uint64_t a_high = a >> 32;
+    uint64_t a_low = (uint32_t)a;
+    uint64_t b_high = b >> 32;
+    uint64_t b_low = (uint32_t)b;
+    uint64_t high_high = a_high * b_high;
+    uint64_t high_low = a_high * b_low;
+    uint64_t low_high = a_low * b_high;
+    uint64_t low_low = a_low * b_low;
+    uint64_t middle = (low_low >> 32) + (uint32_t)high_low + (uint32_t)low_high;
+
+    return ((low_low & 0xFFFFFFFF) | (middle << 32)) ^ (high_high + (high_low >> 32) + (low_high >> 32) + (middle >> 32));
+#endif
+}
+
+static uint64_t read_u64(const char *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t read_u32(const char *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// A multiply-mix hash in the style of wyhash. Inputs up to 16 bytes are
+// read with a few overlapping loads and no loop. Longer ones are
+// consumed 48 bytes at a time in three independent lanes, which keeps
+// the multipliers busy, and their last 16 bytes are always mixed in.
+static uint64_t hash_bytes(const char *data, size_t size)
+{
+    static const uint64_t keys[4] = {0xA0761D6478BD642FULL, 0xE7037ED1A0B428DBULL,
+                                     0x8EBC6AF09C88C6E3ULL, 0x589965CC75374CC3ULL};
+    uint64_t seed = mix_hash(keys[0], keys[1]);
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    if (size <= 16)
+    {
+        if (size >= 4)
+        {
+            size_t middle = (size >> 3) << 2;
+
+            a = (read_u32(data) << 32) | read_u32(&data[middle]);
+            b = (read_u32(&data[size - 4]) << 32) | read_u32(&data[size - 4 - middle]);
+        }
+        else if (size > 0)
+        {
+            a = ((uint64_t)(unsigned char)data[0] << 16)
+                | ((uint64_t)(unsigned char)data[size >> 1] << 8)
+                | (uint64_t)(unsigned char)data[size - 1];
+        }
+    }
+    else
+    {
+        const char *end = data + size;
+
+        if (size > 48)
+        {
+            uint64_t lane_1 = seed;
+            uint64_t lane_2 = seed;
+
+            while (end - data > 48)
+            {
+                seed = mix_hash(read_u64(data) ^ keys[1], read_u64(&data[8]) ^ seed);
+                lane_1 = mix_hash(read_u64(&data[16]) ^ keys[2], read_u64(&data[24]) ^ lane_1);
+                lane_2 = mix_hash(read_u64(&data[32]) ^ keys[3], read_u64(&data[40]) ^ lane_2);
+                data += 48;
+            }
+
+            seed ^= lane_1 ^ lane_2;
+        }
+
+        while (end - data > 16)
+        {
+            seed = mix_hash(read_u64(data) ^ keys[1], read_u64(&data[8]) ^ seed);
+            data += 16;
+        }
+
+        a = read_u64(end - 16);
+        b = read_u64(end - 8);
+    }
+
+    return mix_hash(keys[1] ^ size, mix_hash(a ^ keys[1], b ^ seed));
+}
+
+static uint64_t get_dstr_hash(dstr_t *dstr)
+{
+    if (!(dstr->is_hash_cached))
+    {
+        dstr->hash = hash_bytes(dstr->data, dstr->size);
+        dstr->is_hash_cached = true;
+    }
+
+    return dstr->hash;
+}
+
+static utf8_index_t *get_utf8_index(dstr_t *dstr)
+{
+    if (dstr->utf8_index != NULL)
+    {
+        return dstr->utf8_index;
+    }
+
+    utf8_index_t *index = mem_alloc(sizeof(utf8_index_t));
+
+    index->length = count_codepoints(dstr->data, dstr->size);
+    index->size = 0;
+    index->offsets = NULL;
+
+    if (index->length != dstr->size)
+    {
+        size_t codepoint = 0;
+
+        index->size = ((index->length - 1) / UTF8_INDEX_STRIDE) + 1;
+        index->offsets = mem_alloc(sizeof(size_t) * index->size);
+
+        for (size_t i = 0; i < dstr->size; i++)
+        {
+            if (is_utf8_continuation(dstr->data[i]))
+            {
+                continue;
+            }
+
+            if (codepoint % UTF8_INDEX_STRIDE == 0)
+            {
+                index->offsets[codepoint / UTF8_INDEX_STRIDE] = i;
+            }
+
+            codepoint++;
+        }
+    }
+
+    dstr->utf8_index = index;
+
+    return index;
+}
+
+// Byte offset of a codepoint. codepoint == length gives the size of the dstr.
+static size_t get_utf8_offset(dstr_t *dstr, utf8_index_t *index, size_t codepoint)
+{
+    if (index->offsets == NULL)
+    {
+        return codepoint;
+    }
+    else if (codepoint >= index->length)
+    {
+        return dstr->size;
+    }
+
+    size_t offset = index->offsets[codepoint / UTF8_INDEX_STRIDE];
+    size_t remaining = codepoint % UTF8_INDEX_STRIDE;
+
+    while (remaining > 0)
+    {
+        offset++;
+
+        if (!(is_utf8_continuation(dstr->data[offset])))
+        {
+            remaining--;
+        }
+    }
+
+    return offset;
+}
+
+// Byte offset just past the codepoint that starts at offset.
+static size_t get_utf8_char_end(const char *data, size_t size, size_t offset)
+{
+    offset++;
+
+    while (offset < size && is_utf8_continuation(data[offset]))
+    {
+        offset++;
+    }
+
+    return offset;
+}
+
+// Forward search. Candidates are positions where both the first and
+// the last byte of search_val match, checked 16 at a time with SSE2.
+static const char *find_in_str(const char *data, size_t size, const char *search_val, size_t search_val_size)
+{
+    if (search_val_size == 0 || search_val_size > size)
+    {
+        return NULL;
+    }
+
+    size_t i = 0;
+    size_t last = size - search_val_size;
+    size_t tail = search_val_size - 1;
+
+#if defined(__SSE2__)
+    const __m128i first_byte = _mm_set1_epi8(search_val[0]);
+    const __m128i last_byte = _mm_set1_epi8(search_val[tail]);
+
+    while (i + 16 <= last + 1)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)&data[i]);
+        __m128i block_last = _mm_loadu_si128((const __m128i*)&data[i + tail]);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first_byte),
+                                                                          _mm_cmpeq_epi8(block_last, last_byte)));
+
+        while (mask != 0)
+        {
+            size_t candidate = i + (size_t)__builtin_ctz(mask);
+
+            if (memcmp(&data[candidate], search_val, search_val_size) == 0)
+            {
+                return &data[candidate];
+            }
+
+            mask &= mask - 1;
+        }
+
+        i += 16;
+    }
+#endif
+
+    while (i <= last)
+    {
+        if (data[i] == search_val[0]
+            && memcmp(&data[i], search_val, search_val_size) == 0)
+        {
+            return &data[i];
+        }
+
+        i++;
+    }
+
+    return NULL;
+}
+
+// Same as find_in_str, but walks the candidates from the back.
+static const char *rfind_in_str(const char *data, size_t size, const char *search_val, size_t search_val_size)
+{
+    if (search_val_size == 0 || search_val_size > size)
+    {
+        return NULL;
+    }
+
+    // Candidates are the positions [0, end).
+    size_t end = size - search_val_size + 1;
+    size_t tail = search_val_size - 1;
+
+#if defined(__SSE2__)
+    const __m128i first_byte = _mm_set1_epi8(search_val[0]);
+    const __m128i last_byte = _mm_set1_epi8(search_val[tail]);
+
+    while (end >= 16)
+    {
+        size_t i = end - 16;
+        __m128i block_first = _mm_loadu_si128((const __m128i*)&data[i]);
+        __m128i block_last = _mm_loadu_si128((const __m128i*)&data[i + tail]);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first_byte),
+                                                                          _mm_cmpeq_epi8(block_last, last_byte)));
+
+        while (mask != 0)
+        {
+            unsigned int bit = 31 - (unsigned int)__builtin_clz(mask);
+            size_t candidate = i + bit;
+
+            if (memcmp(&data[candidate], search_val, search_val_size) == 0)
+            {
+                return &data[candidate];
+            }
+
+            mask &= ~(1u << bit);
+        }
+
+        end = i;
+    }
+#endif
+
+    while (end > 0)
+    {
+        end--;
+
+        if (data[end] == search_val[0]
+            && memcmp(&data[end], search_val, search_val_size) == 0)
+        {
+            return &data[end];
+        }
+    }
+
+    return NULL;
+}
+
+static void index_arr_push(dstr_index_arr_t *index_array, size_t value)
+{
+    if (index_array->size == index_array->capacity)
+    {
+        size_t old_capacity = index_array->capacity;
+
+        index_array->capacity *= 2;
+        index_array->data = mem_realloc(index_array->data, sizeof(size_t) * old_capacity, sizeof(size_t) * index_array->capacity);
+    }
+
+    index_array->data[index_array->size++] = value;
+}
+
+static dstr_t *alloc_sized_dstr(const char *data, size_t size)
+{
+    dstr_t *dstr = alloc_setup_capacity(size);
+
+    memcpy(dstr->data, data, size);
+    dstr->data[size] = '\0';
+
+    return dstr;
+}
+
+// An empty array has no data_set, the loops over it just don't run.
+static dstr_arr_t *alloc_sized_dstr_arr(size_t size)
+{
+    dstr_arr_t *dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    dstr_array->size = size;
+    dstr_array->data_set = (size > 0) ? mem_alloc(size * sizeof(dstr_t*)) : NULL;
+
+    return dstr_array;
+}
+
+// Copies the codepoints in data[span_start..span_end) in reverse order,
+// each one keeping its bytes in order.
+static dstr_t *alloc_reversed_utf8(dstr_t *dstr, size_t span_start, size_t span_end)
+{
+    size_t size = span_end - span_start;
+    size_t i = 0;
+    dstr_t *reversed = alloc_setup_capacity(size);
+
+    while (span_end > span_start)
+    {
+        size_t char_start = span_end - 1;
+
+        while (char_start > span_start && is_utf8_continuation(dstr->data[char_start]))
+        {
+            char_start--;
+        }
+
+        memcpy(&reversed->data[i], &dstr->data[char_start], span_end - char_start);
+        i += span_end - char_start;
+        span_end = char_start;
+    }
+
+    reversed->data[size] = '\0';
+
+    return reversed;
+}
+
+// Worker threads are started on first use and kept for the rest of the
+// process. A job runs func(data, participant) once on every worker and
+// once on the calling thread, participant 0, and each func has to
+// finish whatever work the others don't get to. That way a job also
+// works when it runs on the calling thread alone, which it does when
+// there are no workers, when it's started from a worker, or when
+// another thread's job is running. A child of fork has none of the
+// workers, so it starts its own pool on its first job.
+typedef struct thread_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t has_job;
+    pthread_cond_t is_job_done;
+    pthread_mutex_t job_lock;
+    size_t num_of_workers;
+    size_t num_of_busy;
+    size_t job_id;
+    void (*func)(void*, size_t);
+    void *data;
+} thread_pool_t;
+
+static thread_pool_t pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                             PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, NULL, NULL};
+static pthread_mutex_t pool_setup_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic bool is_pool_setup = false;
+static bool is_fork_handler_set = false;
+static _Thread_local bool is_pool_worker = false;
+
+static void *run_pool_worker(void *data)
+{
+    size_t participant = (size_t)(uintptr_t)data;
+    size_t job_id = 0;
+
+    is_pool_worker = true;
+    pthread_mutex_lock(&pool.lock);
+
+    while (true)
+    {
+        while (pool.job_id == job_id)
+        {
+            pthread_cond_wait(&pool.has_job, &pool.lock);
+        }
+
+        job_id = pool.job_id;
+        void (*func)(void*, size_t) = pool.func;
+        void *job_data = pool.data;
+
+        pthread_mutex_unlock(&pool.lock);
+        func(job_data, participant);
+        pthread_mutex_lock(&pool.lock);
+
+        if (--pool.num_of_busy == 0)
+        {
+            pthread_cond_signal(&pool.is_job_done);
+        }
+    }
+
+    return NULL;
+}
+
+// Only the forking thread lives on in the child, and the locks may have
+// been held by threads that are gone, so everything starts over.
+static void reset_pool_in_child(void)
+{
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.has_job, NULL);
+    pthread_cond_init(&pool.is_job_done, NULL);
+    pthread_mutex_init(&pool.job_lock, NULL);
+    pthread_mutex_init(&pool_setup_lock, NULL);
+    pool.num_of_workers = 0;
+    pool.num_of_busy = 0;
+    pool.job_id = 0;
+    pool.func = NULL;
+    pool.data = NULL;
+    atomic_store_explicit(&is_pool_setup, false, memory_order_relaxed);
+}
+
+static void setup_pool(void)
+{
+    // The handler is inherited, so a child doesn't register it again.
+    if (!(is_fork_handler_set))
+    {
+        pthread_atfork(NULL, NULL, reset_pool_in_child);
+        is_fork_handler_set = true;
+    }
+
+    long num_of_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_of_workers = (num_of_cpus > 1) ? (size_t)num_of_cpus - 1 : 0;
+
+    for (size_t i = 0; i < num_of_workers; i++)
+    {
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, run_pool_worker, (void*)(uintptr_t)(i + 1)) != 0)
+        {
+            break;
+        }
+
+        pthread_detach(thread);
+        pool.num_of_workers++;
+    }
+}
+
+// The number of threads a job can run on, the calling one included.
+static size_t get_num_of_participants(void)
+{
+    if (!(atomic_load_explicit(&is_pool_setup, memory_order_acquire)))
+    {
+        pthread_mutex_lock(&pool_setup_lock);
+
+        if (!(atomic_load_explicit(&is_pool_setup, memory_order_relaxed)))
+        {
+            setup_pool();
+            atomic_store_explicit(&is_pool_setup, true, memory_order_release);
+        }
+
+        pthread_mutex_unlock(&pool_setup_lock);
+    }
+
+    return pool.num_of_workers + 1;
+}
+
+static void run_pool_job(void (*func)(void*, size_t), void *data)
+{
+    if (get_num_of_participants() == 1
+        || is_pool_worker
+        || pthread_mutex_trylock(&pool.job_lock) != 0)
+    {
+        func(data, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.func = func;
+    pool.data = data;
+    pool.num_of_busy = pool.num_of_workers;
+    pool.job_id++;
+    pthread_cond_broadcast(&pool.has_job);
+    pthread_mutex_unlock(&pool.lock);
+
+    func(data, 0);
+
+    pthread_mutex_lock(&pool.lock);
+
+    while (pool.num_of_busy > 0)
+    {
+        pthread_cond_wait(&pool.is_job_done, &pool.lock);
+    }
+
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.job_lock);
+}
+
+static size_t get_num_of_threads(size_t num_of_threads, size_t size)
+{
+    // Small inputs aren't worth waking threads for, or starting the pool.
+    size_t max_threads = size / PARALLEL_MIN_CHUNK_SIZE;
+
+    if (max_threads <= 1)
+    {
+        return 1;
+    }
+
+    if (num_of_threads == 0)
+    {
+        num_of_threads = get_num_of_participants();
+    }
+
+    if (num_of_threads > max_threads)
+    {
+        num_of_threads = max_threads;
+    }
+
+    return (num_of_threads == 0) ? 1 : num_of_threads;
+}
+
+typedef struct task_job
+{
+    void (*func)(void*);
+    char *tasks;
+    size_t task_size;
+    size_t num_of_tasks;
+    _Atomic size_t next_task;
+} task_job_t;
+
+static void run_tasks(void *data, size_t participant)
+{
+    (void)participant;
+    task_job_t *job = data;
+    size_t i = atomic_fetch_add_explicit(&job->next_task, 1, memory_order_relaxed);
+
+    while (i < job->num_of_tasks)
+    {
+        job->func(&job->tasks[i * job->task_size]);
+        i = atomic_fetch_add_explicit(&job->next_task, 1, memory_order_relaxed);
+    }
+}
+
+// Runs func on each of the tasks on the pool, which hands them
+// out in order to whichever thread is free first.
+static void run_in_pool(void (*func)(void*), void *tasks, size_t task_size, size_t num_of_tasks)
+{
+    task_job_t job = {func, tasks, task_size, num_of_tasks, 0};
+
+    if (num_of_tasks == 1)
+    {
+        func(tasks);
+        return;
+    }
+
+    run_pool_job(run_tasks, &job);
+}
+
+// A range of dstr_arr_t elements. Its owner takes elements from the
+// front, and threads that ran out of their own steal half from the back.
+typedef struct element_range
+{
+    pthread_mutex_t lock;
+    size_t start;
+    size_t end;
+} element_range_t;
+
+typedef struct for_each_job
+{
+    dstr_t **data_set;
+    void (*func)(dstr_t*, void*);
+    void *context;
+    size_t num_of_ranges;
+    element_range_t *ranges;
+} for_each_job_t;
+
+static bool take_elements(element_range_t *range, size_t *start, size_t *end)
+{
+    pthread_mutex_lock(&range->lock);
+
+    *start = range->start;
+    *end = (range->end - range->start > FOR_EACH_GRAIN_SIZE) ? range->start + FOR_EACH_GRAIN_SIZE : range->end;
+    range->start = *end;
+
+    pthread_mutex_unlock(&range->lock);
+
+    return (*start < *end);
+}
+
+static bool steal_elements(for_each_job_t *job, size_t participant)
+{
+    element_range_t *own = &job->ranges[participant];
+
+    for (size_t i = 1; i < job->num_of_ranges; i++)
+    {
+        element_range_t *victim = &job->ranges[(participant + i) % job->num_of_ranges];
+        size_t start = 0;
+        size_t end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+
+        if (victim->start < victim->end)
+        {
+            start = victim->start + ((victim->end - victim->start) / 2);
+            end = victim->end;
+            victim->end = start;
+        }
+
+        pthread_mutex_unlock(&victim->lock);
+
+        if (start < end)
+        {
+            pthread_mutex_lock(&own->lock);
+            own->start = start;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void run_for_each(void *data, size_t participant)
+{
+    for_each_job_t *job = data;
+    size_t start = 0;
+    size_t end = 0;
+
+    do
+    {
+        while (take_elements(&job->ranges[participant], &start, &end))
+        {
+            for (size_t i = start; i < end; i++)
+            {
+                job->func(job->data_set[i], job->context);
+            }
+        }
+    }
+    while (steal_elements(job, participant));
+}
+
+// One chunk of a parallel scan. A chunk owns the matches that start
+// in [start, end), so a match straddling end belongs to it, and the
+// text from field_start up to each of its matches.
+typedef struct scan_chunk
+{
+    const char *data;
+    size_t size;
+    const char *search_val;
+    size_t search_val_size;
+    size_t start;
+    size_t end;
+    dstr_index_arr_t matches;
+    size_t num_of_matches;
+    size_t first_match;
+    size_t last_match;
+    size_t field_start;
+    _Atomic size_t *earliest_match;
+    dstr_t **fields;
+    char *output;
+    const char *new_str;
+    size_t new_str_size;
+} scan_chunk_t;
+
+// Returns where the first match at or after start begins,
+// or SIZE_MAX when none starts before chunk->end.
+static size_t find_chunk_match(scan_chunk_t *chunk, size_t start)
+{
+    size_t search_end = chunk->end + chunk->search_val_size - 1;
+
+    if (search_end > chunk->size)
+    {
+        search_end = chunk->size;
+    }
+
+    if (start >= chunk->end)
+    {
+        return SIZE_MAX;
+    }
+
+    const char *found = find_in_str(&chunk->data[start], search_end - start, chunk->search_val, chunk->search_val_size);
+
+    return (found == NULL) ? SIZE_MAX : (size_t)(found - chunk->data);
+}
+
+static scan_chunk_t *alloc_scan_chunks(const char *data, size_t size, const char *search_val, size_t num_of_chunks)
+{
+    scan_chunk_t *chunks = mem_alloc(sizeof(scan_chunk_t) * num_of_chunks);
+
+    for (size_t i = 0; i < num_of_chunks; i++)
+    {
+        memset(&chunks[i], 0, sizeof(scan_chunk_t));
+        chunks[i].data = data;
+        chunks[i].size = size;
+        chunks[i].search_val = search_val;
+        chunks[i].search_val_size = strlen(search_val);
+        chunks[i].start = (size / num_of_chunks) * i;
+        chunks[i].end = (i + 1 == num_of_chunks) ? size : (size / num_of_chunks) * (i + 1);
+    }
+
+    return chunks;
+}
+
+static void free_scan_chunks(scan_chunk_t *chunks, size_t num_of_chunks)
+{
+    for (size_t i = 0; i < num_of_chunks; i++)
+    {
+        mem_free(chunks[i].matches.data, sizeof(size_t) * chunks[i].matches.capacity);
+    }
+
+    mem_free(chunks, sizeof(scan_chunk_t) * num_of_chunks);
+}
+
+static void count_chunk_matches(void *data)
+{
+    scan_chunk_t *chunk = data;
+    size_t found = find_chunk_match(chunk, chunk->start);
+
+    chunk->first_match = found;
+
+    while (found != SIZE_MAX)
+    {
+        chunk->num_of_matches++;
+        chunk->last_match = found;
+        found = find_chunk_match(chunk, found + chunk->search_val_size);
+    }
+}
+
+// A chunk searched from its own start, but a match of the chunk before
+// may run past it. Searching again from where that one ends finds the
+// same matches as a serial pass would, and as soon as one of them is
+// also a match the chunk found, the rest are the same too. Walks both
+// until then and returns where the last match of the chunk ends.
+static size_t fix_chunk_count(scan_chunk_t *chunk, size_t field_start)
+{
+    size_t last_end = field_start;
+
+    if (chunk->num_of_matches > 0 && chunk->first_match < field_start)
+    {
+        size_t found = chunk->first_match;
+        size_t fixed = find_chunk_match(chunk, field_start);
+
+        while (found != fixed)
+        {
+            if (found < fixed)
+            {
+                chunk->num_of_matches--;
+                found = find_chunk_match(chunk, found + chunk->search_val_size);
+            }
+            else
+            {
+                chunk->num_of_matches++;
+                last_end = fixed + chunk->search_val_size;
+                fixed = find_chunk_match(chunk, fixed + chunk->search_val_size);
+            }
+        }
+
+        if (found == SIZE_MAX)
+        {
+            return last_end;
+        }
+    }
+
+    return (chunk->num_of_matches > 0) ? chunk->last_match + chunk->search_val_size : last_end;
+}
+
+static void find_chunk_matches(void *data)
+{
+    scan_chunk_t *chunk = data;
+    size_t found = find_chunk_match(chunk, chunk->start);
+
+    chunk->matches.capacity = DEFAULT_CAPACITY;
+    chunk->matches.data = mem_alloc(sizeof(size_t) * DEFAULT_CAPACITY);
+
+    while (found != SIZE_MAX)
+    {
+        index_arr_push(&chunk->matches, found);
+        found = find_chunk_match(chunk, found + chunk->search_val_size);
+    }
+}
+
+// Same as fix_chunk_count, but for the matches themselves.
+static void fix_chunk_matches(scan_chunk_t *chunk, size_t field_start)
+{
+    dstr_index_arr_t *matches = &chunk->matches;
+
+    if (matches->size == 0 || matches->data[0] >= field_start)
+    {
+        return;
+    }
+
+    dstr_index_arr_t fixed = {0, DEFAULT_CAPACITY, mem_alloc(sizeof(size_t) * DEFAULT_CAPACITY)};
+    size_t found = find_chunk_match(chunk, field_start);
+    size_t i = 0;
+
+    while (found != SIZE_MAX)
+    {
+        while (i < matches->size && matches->data[i] < found)
+        {
+            i++;
+        }
+
+        if (i < matches->size && matches->data[i] == found)
+        {
+            for (; i < matches->size; i++)
+            {
+                index_arr_push(&fixed, matches->data[i]);
+            }
+
+            break;
+        }
+
+        index_arr_push(&fixed, found);
+        found = find_chunk_match(chunk, found + chunk->search_val_size);
+    }
+
+    mem_free(matches->data, sizeof(size_t) * matches->capacity);
+    *matches = fixed;
+}
+
+// Fixes up the matches of all chunks, keeps only the first max_matches
+// of them unless it's 0, and sets where the text of each chunk starts.
+// Returns where the text after the last match starts.
+static size_t fix_scan_chunks(scan_chunk_t *chunks, size_t num_of_chunks, size_t max_matches, size_t *num_of_matches)
+{
+    size_t field_start = 0;
+
+    *num_of_matches = 0;
+
+    for (size_t i = 0; i < num_of_chunks; i++)
+    {
+        fix_chunk_matches(&chunks[i], field_start);
+
+        if (max_matches > 0 && *num_of_matches + chunks[i].matches.size > max_matches)
+        {
+            chunks[i].matches.size = max_matches - *num_of_matches;
+        }
+
+        chunks[i].field_start = field_start;
+        *num_of_matches += chunks[i].matches.size;
+
+        if (chunks[i].matches.size > 0)
+        {
+            field_start = chunks[i].matches.data[chunks[i].matches.size - 1] + chunks[i].search_val_size;
+        }
+    }
+
+    return field_start;
+}
+
+static void find_chunk_earliest(void *data)
+{
+    scan_chunk_t *chunk = data;
+    size_t found = SIZE_MAX;
+
+    // Searches in blocks, and stops as soon as a chunk
+    // before this one has found a match.
+    for (size_t start = chunk->start; start < chunk->end && found == SIZE_MAX; start += PARALLEL_CANCEL_BLOCK_SIZE)
+    {
+        if (atomic_load_explicit(chunk->earliest_match, memory_order_relaxed) < start)
+        {
+            return;
+        }
+
+        size_t end = chunk->end;
+        chunk->end = (end - start > PARALLEL_CANCEL_BLOCK_SIZE) ? start + PARALLEL_CANCEL_BLOCK_SIZE : end;
+        found = find_chunk_match(chunk, start);
+        chunk->end = end;
+    }
+
+    size_t earliest = atomic_load_explicit(chunk->earliest_match, memory_order_relaxed);
+
+    while (found < earliest
+        && !(atomic_compare_exchange_weak_explicit(chunk->earliest_match, &earliest, found, memory_order_relaxed, memory_order_relaxed)))
+    {
+    }
+}
+
+static void alloc_split_fields(void *data)
+{
+    scan_chunk_t *chunk = data;
+    size_t field_start = chunk->field_start;
+
+    for (size_t i = 0; i < chunk->matches.size; i++)
+    {
+        chunk->fields[i] = alloc_sized_dstr(&chunk->data[field_start], chunk->matches.data[i] - field_start);
+        field_start = chunk->matches.data[i] + chunk->search_val_size;
+    }
+}
+
+static void copy_replaced_chunk(void *data)
+{
+    scan_chunk_t *chunk = data;
+    size_t field_start = chunk->field_start;
+    char *output = chunk->output;
+
+    for (size_t i = 0; i < chunk->matches.size; i++)
+    {
+        size_t field_size = chunk->matches.data[i] - field_start;
+
+        memcpy(output, &chunk->data[field_start], field_size);
+        memcpy(&output[field_size], chunk->new_str, chunk->new_str_size);
+        output += field_size + chunk->new_str_size;
+        field_start = chunk->matches.data[i] + chunk->search_val_size;
+    }
+}
+
+static bool is_small_scan(size_t size)
+{
+    return size < 2 * PARALLEL_MIN_CHUNK_SIZE;
+}
+
+// The serial kernel the small scans use, so they don't allocate or touch
+// the pool. Counts up to max_matches matches unless it's 0.
+static size_t count_serial(const char *data, size_t size, const char *search_val, size_t search_val_size, size_t max_matches)
+{
+    const char *end = data + size;
+    const char *found = find_in_str(data, size, search_val, search_val_size);
+    size_t num_of_matches = 0;
+
+    while (found != NULL && (max_matches == 0 || num_of_matches < max_matches))
+    {
+        num_of_matches++;
+        data = found + search_val_size;
+        found = find_in_str(data, (size_t)(end - data), search_val, search_val_size);
+    }
+
+    return num_of_matches;
+}
+
+// Counts the matches first, so the only allocation is the new buffer.
+static bool replace_in_small_dstr(dstr_t *dstr, const char *old_str, const char *new_str, size_t count)
+{
+    size_t old_str_size = strlen(old_str);
+    size_t num_of_occurrences = count_serial(dstr->data, dstr->size, old_str, old_str_size, count);
+
+    if (num_of_occurrences == 0)
+    {
+        return false;
+    }
+
+    invalidate_cached(dstr);
+
+    size_t new_str_size = strlen(new_str);
+    size_t total_size = ((dstr->size - (old_str_size  * num_of_occurrences)) + (new_str_size * num_of_occurrences));
+
+    size_t capacity = calculate_capacity(total_size);
+    char *replacement = alloc_dstr_data(capacity);
+    char *output = replacement;
+    const char *data = dstr->data;
+    const char *end = dstr->data + dstr->size;
+
+    for (size_t i = 0; i < num_of_occurrences; i++)
+    {
+        const char *found = find_in_str(data, (size_t)(end - data), old_str, old_str_size);
+
+        memcpy(output, data, (size_t)(found - data));
+        output += found - data;
+        memcpy(output, new_str, new_str_size);
+        output += new_str_size;
+        data = found + old_str_size;
+    }
+
+    memcpy(output, data, (size_t)(end - data));
+    replacement[total_size] = '\0';
+
+    dstr_data_free(dstr);
+    set_dstr_data(dstr, replacement, capacity);
+    set_dstr_size(dstr, total_size);
+
+    return true;
+}
+
+// Returns false when old_str isn't in the dstr.
+static bool replace_in_dstr(dstr_t *dstr, const char *old_str, const char *new_str, size_t count)
+{
+    if (is_small_scan(dstr->size))
+    {
+        return replace_in_small_dstr(dstr, old_str, new_str, count);
+    }
+
+    size_t num_of_threads = get_num_of_threads(0, dstr->size);
+    size_t num_of_occurrences = 0;
+    scan_chunk_t *chunks = alloc_scan_chunks(dstr->data, dstr->size, old_str, num_of_threads);
+
+    if (*old_str != '\0')
+    {
+        run_in_pool(find_chunk_matches, chunks, sizeof(scan_chunk_t), num_of_threads);
+    }
+
+    size_t field_start = fix_scan_chunks(chunks, num_of_threads, count, &num_of_occurrences);
+
+    if (num_of_occurrences == 0)
+    {
+        free_scan_chunks(chunks, num_of_threads);
+        return false;
+    }
+
+    invalidate_cached(dstr);
+
+    size_t old_str_size = strlen(old_str);
+    size_t new_str_size = strlen(new_str);
+    size_t total_size = ((dstr->size - (old_str_size  * num_of_occurrences)) + (new_str_size * num_of_occurrences));
+
+    size_t capacity = calculate_capacity(total_size);
+    char *replacement = alloc_dstr_data(capacity);
+
+    // Each chunk writes where the text before it ends up,
+    // which is known from the number of matches before it.
+    for (size_t i = 0, num_of_replacements = 0; i < num_of_threads; i++)
+    {
+        chunks[i].output = &replacement[chunks[i].field_start + (num_of_replacements * new_str_size) - (num_of_replacements * old_str_size)];
+        chunks[i].new_str = new_str;
+        chunks[i].new_str_size = new_str_size;
+        num_of_replacements += chunks[i].matches.size;
+    }
+
+    run_in_pool(copy_replaced_chunk, chunks, sizeof(scan_chunk_t), num_of_threads);
+
+    memcpy(&replacement[total_size - (dstr->size - field_start)], &dstr->data[field_start], dstr->size - field_start);
+    replacement[total_size] = '\0';
+    free_scan_chunks(chunks, num_of_threads);
+
+    dstr_data_free(dstr);
+    set_dstr_data(dstr, replacement, capacity);
+    set_dstr_size(dstr, total_size);
+
+    return true;
+}
+
+typedef struct replace_context
+{
+    const char *old_str;
+    const char *new_str;
+} replace_context_t;
+
+static void strip_element(dstr_t *dstr, void *context)
+{
+    (void)context;
+    dstr_strip(dstr);
+}
+
+static void strip_chars_element(dstr_t *dstr, void *context)
+{
+    dstr_strip_chars(dstr, context);
+}
+
+static void lower_element(dstr_t *dstr, void *context)
+{
+    (void)context;
+    dstr_lower(dstr);
+}
+
+static void upper_element(dstr_t *dstr, void *context)
+{
+    (void)context;
+    dstr_upper(dstr);
+}
+
+// Elements without old_str are left alone without a warning.
+static void replace_element(dstr_t *dstr, void *context)
+{
+    replace_context_t *replace_context = context;
+
+    replace_in_dstr(dstr, replace_context->old_str, replace_context->new_str, 0);
+}
+
+// The parallel scans split data[0, size) into one chunk per thread. With
+// one thread they run on the calling thread, and give the same results.
+static size_t count_in_str(const char *data, size_t size, const char *search_val)
+{
+    if (is_small_scan(size))
+    {
+        return count_serial(data, size, search_val, strlen(search_val), 0);
+    }
+
+    size_t num_of_threads = get_num_of_threads(0, size);
+    scan_chunk_t *chunks = alloc_scan_chunks(data, size, search_val, num_of_threads);
+    size_t num_of_matches = 0;
+    size_t field_start = 0;
+
+    run_in_pool(count_chunk_matches, chunks, sizeof(scan_chunk_t), num_of_threads);
+
+    for (size_t i = 0; i < num_of_threads; i++)
+    {
+        field_start = fix_chunk_count(&chunks[i], field_start);
+        num_of_matches += chunks[i].num_of_matches;
+    }
+
+    free_scan_chunks(chunks, num_of_threads);
+
+    return num_of_matches;
+}
+
+static size_t find_earliest_in_str(const char *data, size_t size, const char *search_val)
+{
+    if (is_small_scan(size))
+    {
+        const char *found = find_in_str(data, size, search_val, strlen(search_val));
+
+        return (found == NULL) ? SIZE_MAX : (size_t)(found - data);
+    }
+
+    size_t num_of_threads = get_num_of_threads(0, size);
+    scan_chunk_t *chunks = alloc_scan_chunks(data, size, search_val, num_of_threads);
+    _Atomic size_t earliest_match = SIZE_MAX;
+
+    for (size_t i = 0; i < num_of_threads; i++)
+    {
+        chunks[i].earliest_match = &earliest_match;
+    }
+
+    run_in_pool(find_chunk_earliest, chunks, sizeof(scan_chunk_t), num_of_threads);
+    free_scan_chunks(chunks, num_of_threads);
+
+    return atomic_load(&earliest_match);
+}
+
+// Returns the slot that holds data, or the empty slot where it would go.
+static intern_slot_t *find_intern_slot(dstr_intern_t *intern, const char *data, size_t size, uint64_t hash)
+{
+    size_t mask = intern->capacity - 1;
+    size_t i = (size_t)hash & mask;
+
+    while (intern->slots[i].dstr != NULL)
+    {
+        dstr_t *dstr = intern->slots[i].dstr;
+
+        if (intern->slots[i].hash == hash && dstr->size == size && memcmp(dstr->data, data, size) == 0)
+        {
+            break;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    return &intern->slots[i];
+}
+
+static void grow_intern(dstr_intern_t *intern)
+{
+    intern_slot_t *old_slots = intern->slots;
+    size_t old_capacity = intern->capacity;
+
+    intern->capacity *= 2;
+    intern->slots = mem_alloc(sizeof(intern_slot_t) * intern->capacity);
+    memset(intern->slots, 0, sizeof(intern_slot_t) * intern->capacity);
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_slots[i].dstr != NULL)
+        {
+            size_t j = (size_t)old_slots[i].hash & (intern->capacity - 1);
+
+            while (intern->slots[j].dstr != NULL)
+            {
+                j = (j + 1) & (intern->capacity - 1);
+            }
+
+            intern->slots[j] = old_slots[i];
+        }
+    }
+
+    mem_free(old_slots, sizeof(intern_slot_t) * old_capacity);
+}
+
+static dstr_t *intern_bytes(dstr_intern_t *intern, const char *data, size_t size, uint64_t hash)
+{
+    intern_slot_t *slot = find_intern_slot(intern, data, size, hash);
+
+    if (slot->dstr != NULL)
+    {
+        return slot->dstr;
+    }
+
+    // Kept at most 3/4 full so probe runs stay short.
+    if ((intern->size + 1) * 4 > intern->capacity * 3)
+    {
+        grow_intern(intern);
+        slot = find_intern_slot(intern, data, size, hash);
+    }
+
+    slot->hash = hash;
+    slot->dstr = alloc_sized_dstr(data, size);
+    slot->dstr->hash = hash;
+    slot->dstr->is_hash_cached = true;
+    intern->size++;
+
+    return slot->dstr;
+}
+
+static uint64_t load_sort_prefix(dstr_t *dstr, size_t depth)
+{
+    uint64_t prefix = 0;
+
+    if (depth + 8 <= dstr->size)
+    {
+        memcpy(&prefix, &dstr->data[depth], sizeof(prefix));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        prefix = __builtin_bswap64(prefix);
+#endif
+        return prefix;
+    }
+
+    for (size_t i = 0; depth + i < dstr->size; i++)
+    {
+        prefix |= (uint64_t)(unsigned char)dstr->data[depth + i] << (56 - (8 * i));
+    }
+
+    return prefix;
+}
+
+// A key ends inside the prefix at depth when it has no bytes after it.
+// The zero padding of a short prefix looks like '\0' bytes, so a key that
+// ended has to be told apart by its size, not by its prefix.
+static bool is_sort_key_ended(const sort_entry_t *entry, size_t depth)
+{
+    return (entry->dstr->size <= depth + 8);
+}
+
+static int compare_sort_indexes(const void *first, const void *second)
+{
+    size_t first_index = ((const sort_entry_t*)first)->index;
+    size_t second_index = ((const sort_entry_t*)second)->index;
+
+    return (first_index > second_index) - (first_index < second_index);
+}
+
+// Keys with the same prefix that ended inside it are prefixes of each
+// other, so the shorter one goes first.
+static int compare_sort_sizes(const void *first, const void *second)
+{
+    size_t first_size = ((const sort_entry_t*)first)->dstr->size;
+    size_t second_size = ((const sort_entry_t*)second)->dstr->size;
+
+    if (first_size != second_size)
+    {
+        return (first_size < second_size) ? -1 : 1;
+    }
+
+    return compare_sort_indexes(first, second);
+}
+
+// Compares two keys whose bytes before depth are the same.
+static int compare_sort_entries(const sort_entry_t *first, const sort_entry_t *second, size_t depth, bool is_stable)
+{
+    if (first->prefix != second->prefix)
+    {
+        return (first->prefix < second->prefix) ? -1 : 1;
+    }
+
+    size_t start = depth + 8;
+    size_t first_size = first->dstr->size;
+    size_t second_size = second->dstr->size;
+
+    if (first_size > start && second_size > start)
+    {
+        size_t rest_size = ((first_size < second_size) ? first_size : second_size) - start;
+        int result = memcmp(&first->dstr->data[start], &second->dstr->data[start], rest_size);
+
+        if (result != 0)
+        {
+            return result;
+        }
+    }
+
+    if (first_size != second_size)
+    {
+        return (first_size < second_size) ? -1 : 1;
+    }
+
+    return is_stable ? compare_sort_indexes(first, second) : 0;
+}
+
+static bool are_sort_sizes_equal(const sort_entry_t *entries, size_t size)
+{
+    for (size_t i = 1; i < size; i++)
+    {
+        if (entries[i].dstr->size != entries[0].dstr->size)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Moves the entries whose keys ended at depth to the front and returns
+// how many there are.
+static size_t partition_ended_entries(sort_entry_t *entries, size_t size, size_t depth)
+{
+    size_t num_of_ended = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (is_sort_key_ended(&entries[i], depth))
+        {
+            sort_entry_t temp = entries[num_of_ended];
+            entries[num_of_ended++] = entries[i];
+            entries[i] = temp;
+        }
+    }
+
+    return num_of_ended;
+}
+
+static void insertion_sort_entries(sort_entry_t *entries, size_t size, size_t depth, bool is_stable)
+{
+    for (size_t i = 1; i < size; i++)
+    {
+        sort_entry_t entry = entries[i];
+        size_t j = i;
+
+        while (j > 0 && compare_sort_entries(&entry, &entries[j - 1], depth, is_stable) < 0)
+        {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+
+        entries[j] = entry;
+    }
+}
+
+static void swap_sort_entries(sort_entry_t *first, sort_entry_t *second)
+{
+    sort_entry_t temp = *first;
+    *first = *second;
+    *second = temp;
+}
+
+static uint64_t get_median_prefix(sort_entry_t *entries, size_t size)
+{
+    uint64_t first = entries[0].prefix;
+    uint64_t middle = entries[size / 2].prefix;
+    uint64_t last = entries[size - 1].prefix;
+
+    if (first < middle)
+    {
+        return (middle < last) ? middle : ((first < last) ? last : first);
+    }
+
+    return (first < last) ? first : ((middle < last) ? last : middle);
+}
+
+// Multikey quicksort with 8 byte prefixes as the keys. Each pass splits
+// the entries into <, == and > the pivot prefix. The == part moves on to
+// the next 8 bytes, or is done when its keys ended. Recurses into the two
+// smaller parts and loops on the largest, so the stack stays shallow.
+static void sort_entries(sort_entry_t *entries, size_t size, size_t depth, bool is_stable)
+{
+    while (size > SORT_INSERTION_SIZE)
+    {
+        uint64_t pivot = get_median_prefix(entries, size);
+        size_t less = 0;
+        size_t i = 0;
+        size_t greater = size;
+
+        while (i < greater)
+        {
+            if (entries[i].prefix < pivot)
+            {
+                swap_sort_entries(&entries[less++], &entries[i++]);
+            }
+            else if (entries[i].prefix > pivot)
+            {
+                swap_sort_entries(&entries[i], &entries[--greater]);
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        sort_entry_t *equal = &entries[less];
+        size_t num_of_equal = greater - less;
+        size_t num_of_greater = size - greater;
+
+        // The keys that ended here are prefixes of the ones that didn't,
+        // so they go first and only their sizes are left to sort by.
+        size_t num_of_ended = partition_ended_entries(equal, num_of_equal, depth);
+
+        if (num_of_ended > 1
+            && (is_stable || !(are_sort_sizes_equal(equal, num_of_ended))))
+        {
+            qsort(equal, num_of_ended, sizeof(sort_entry_t), compare_sort_sizes);
+        }
+
+        equal += num_of_ended;
+        num_of_equal -= num_of_ended;
+
+        for (size_t j = 0; j < num_of_equal; j++)
+        {
+            equal[j].prefix = load_sort_prefix(equal[j].dstr, depth + 8);
+        }
+
+        if (num_of_equal >= less && num_of_equal >= num_of_greater)
+        {
+            sort_entries(entries, less, depth, is_stable);
+            sort_entries(&entries[greater], num_of_greater, depth, is_stable);
+            entries = equal;
+            size = num_of_equal;
+            depth += 8;
+        }
+        else
+        {
+            if (num_of_equal > 0)
+            {
+                sort_entries(equal, num_of_equal, depth + 8, is_stable);
+            }
+
+            if (less >= num_of_greater)
+            {
+                sort_entries(&entries[greater], num_of_greater, depth, is_stable);
+                size = less;
+            }
+            else
+            {
+                sort_entries(entries, less, depth, is_stable);
+                entries = &entries[greater];
+                size = num_of_greater;
+            }
+        }
+    }
+
+    insertion_sort_entries(entries, size, depth, is_stable);
+}
+
+static void sort_bucket(void *data)
+{
+    sort_bucket_t *bucket = data;
+
+    sort_entries(bucket->entries, bucket->size, 0, bucket->is_stable);
+}
+
+static int compare_bucket_sizes(const void *first, const void *second)
+{
+    size_t first_size = ((const sort_bucket_t*)first)->size;
+    size_t second_size = ((const sort_bucket_t*)second)->size;
+
+    return (first_size < second_size) - (first_size > second_size);
+}
+
+// Spreads the entries over buckets by their first two bytes, which keeps
+// their order, and sorts the buckets on the pool, the largest first.
+static void sort_entries_parallel(sort_entry_t *entries, size_t size, bool is_stable)
+{
+    size_t num_of_buckets = 1 << 16;
+    size_t *starts = mem_alloc(sizeof(size_t) * (num_of_buckets + 1));
+    sort_entry_t *spread = mem_alloc(sizeof(sort_entry_t) * size);
+    sort_bucket_t *buckets = mem_alloc(sizeof(sort_bucket_t) * num_of_buckets);
+    size_t num_of_tasks = 0;
+
+    memset(starts, 0, sizeof(size_t) * (num_of_buckets + 1));
+
+    for (size_t i = 0; i < size; i++)
+    {
+        starts[(entries[i].prefix >> 48) + 1]++;
+    }
+
+    for (size_t i = 0; i < num_of_buckets; i++)
+    {
+        starts[i + 1] += starts[i];
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        spread[starts[entries[i].prefix >> 48]++] = entries[i];
+    }
+
+    // The scatter moved every start to the end of its bucket.
+    for (size_t i = 0, start = 0; i < num_of_buckets; i++)
+    {
+        size_t bucket_size = starts[i] - start;
+
+        if (bucket_size > 1)
+        {
+            buckets[num_of_tasks].entries = &spread[start];
+            buckets[num_of_tasks].size = bucket_size;
+            buckets[num_of_tasks].is_stable = is_stable;
+            num_of_tasks++;
+        }
+
+        start = starts[i];
+    }
+
+    qsort(buckets, num_of_tasks, sizeof(sort_bucket_t), compare_bucket_sizes);
+    run_in_pool(sort_bucket, buckets, sizeof(sort_bucket_t), num_of_tasks);
+
+    memcpy(entries, spread, sizeof(sort_entry_t) * size);
+
+    mem_free(buckets, sizeof(sort_bucket_t) * num_of_buckets);
+    mem_free(spread, sizeof(sort_entry_t) * size);
+    mem_free(starts, sizeof(size_t) * (num_of_buckets + 1));
+}
+
+static void sort_dstr_arr(dstr_arr_t *dstr_array, bool is_stable, bool is_parallel)
+{
+    if (dstr_array->size < 2)
+    {
+        return;
+    }
+
+    sort_entry_t *entries = mem_alloc(sizeof(sort_entry_t) * dstr_array->size);
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        entries[i].prefix = load_sort_prefix(dstr_array->data_set[i], 0);
+        entries[i].dstr = dstr_array->data_set[i];
+        entries[i].index = i;
+    }
+
+    if (is_parallel
+        && dstr_array->size >= PARALLEL_SORT_MIN_SIZE
+        && get_num_of_participants() > 1)
+    {
+        sort_entries_parallel(entries, dstr_array->size, is_stable);
+    }
+    else
+    {
+        sort_entries(entries, dstr_array->size, 0, is_stable);
+    }
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        dstr_array->data_set[i] = entries[i].dstr;
+    }
+
+    mem_free(entries, sizeof(sort_entry_t) * dstr_array->size);
+}
+
+// Writes all of iov, picking up after short writes and signals.
+static bool write_iovecs(int fd, struct iovec *iov, size_t num_of_iovecs)
+{
+    while (num_of_iovecs > 0)
+    {
+        // Empty ones are skipped first, so the batch always has bytes to
+        // write and writing none of them is a failure, not progress.
+        if (iov->iov_len == 0)
+        {
+            iov++;
+            num_of_iovecs--;
+            continue;
+        }
+
+        int count = (num_of_iovecs > WRITER_MAX_IOVECS) ? WRITER_MAX_IOVECS : (int)num_of_iovecs;
+        ssize_t written = writev(fd, iov, count);
+
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (written <= 0)
+        {
+            return false;
+        }
+
+        size_t left = (size_t)written;
+
+        while (num_of_iovecs > 0 && left >= iov->iov_len)
+        {
+            left -= iov->iov_len;
+            iov++;
+            num_of_iovecs--;
+        }
+
+        if (num_of_iovecs > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+
+    return true;
+}
+
+// Writes the buffer, then data, with one writev.
+static bool flush_writer(dstr_writer_t *writer, const char *data, size_t size)
+{
+    struct iovec iov[2] = {{writer->buffer, writer->size}, {(void*)data, size}};
+
+    if (!(writer->is_failed) && !(write_iovecs(writer->fd, iov, 2)))
+    {
+        printf("%s: %swarning:%s failed to write content%s\n", __func__, PURPLE, WHITE, RESET);
+        writer->is_failed = true;
+    }
+
+    writer->size = 0;
+
+    return !(writer->is_failed);
+}
+
+static void write_to_writer(dstr_writer_t *writer, const char *data, size_t size)
+{
+    if (size >= writer->capacity / 2)
+    {
+        flush_writer(writer, data, size);
+        return;
+    }
+
+    if (writer->size + size > writer->capacity)
+    {
+        flush_writer(writer, NULL, 0);
+    }
+
+    memcpy(&writer->buffer[writer->size], data, size);
+    writer->size += size;
+}
+
+static int8_t get_map_tag(uint64_t hash)
+{
+    return (int8_t)(hash & 0x7F);
+}
+
+// Bit i is set when control[i] == tag.
+static unsigned int match_map_group(const int8_t *control, int8_t tag)
+{
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i*)control);
+
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+#else
+    unsigned int mask = 0;
+
+    for (unsigned int i = 0; i < MAP_GROUP_SIZE; i++)
+    {
+        mask |= (unsigned int)(control[i] == tag) << i;
+    }
+
+    return mask;
+#endif
+}
+
+// Bit i is set when control[i] is MAP_EMPTY or MAP_DELETED, which are
+// the only control bytes with the high bit set.
+static unsigned int match_map_free(const int8_t *control)
+{
+#if defined(__SSE2__)
+    return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)control));
+#else
+    unsigned int mask = 0;
+
+    for (unsigned int i = 0; i < MAP_GROUP_SIZE; i++)
+    {
+        mask |= (unsigned int)(control[i] < 0) << i;
+    }
+
+    return mask;
+#endif
+}
+
+static map_slot_t *find_map_slot(dstr_map_t *map, const char *key, size_t size, uint64_t hash)
+{
+    size_t group_mask = (map->capacity / MAP_GROUP_SIZE) - 1;
+    size_t group = (size_t)(hash >> 7) & group_mask;
+    int8_t tag = get_map_tag(hash);
+
+    for (size_t i = 1; i <= group_mask + 1; i++)
+    {
+        const int8_t *control = &map->control[group * MAP_GROUP_SIZE];
+        unsigned int mask = match_map_group(control, tag);
+
+        while (mask != 0)
+        {
+            map_slot_t *slot = &map->slots[(group * MAP_GROUP_SIZE) + (size_t)__builtin_ctz(mask)];
+
+            if (slot->key->size == size && memcmp(slot->key->data, key, size) == 0)
+            {
+                return slot;
+            }
+
+            mask &= mask - 1;
+        }
+
+        // A group with an empty slot ends every probe that reaches it.
+        if (match_map_group(control, MAP_EMPTY) != 0)
+        {
+            return NULL;
+        }
+
+        group = (group + i) & group_mask;
+    }
+
+    return NULL;
+}
+
+// Returns the index of the first empty or deleted slot on the probe path.
+static size_t find_free_map_slot(dstr_map_t *map, uint64_t hash)
+{
+    size_t group_mask = (map->capacity / MAP_GROUP_SIZE) - 1;
+    size_t group = (size_t)(hash >> 7) & group_mask;
+    unsigned int mask = match_map_free(&map->control[group * MAP_GROUP_SIZE]);
+
+    // The load factor keeps a free slot somewhere, so this ends.
+    for (size_t i = 1; mask == 0; i++)
+    {
+        group = (group + i) & group_mask;
+        mask = match_map_free(&map->control[group * MAP_GROUP_SIZE]);
+    }
+
+    return (group * MAP_GROUP_SIZE) + (size_t)__builtin_ctz(mask);
+}
+
+static void setup_map_slots(dstr_map_t *map, size_t capacity)
+{
+    map->capacity = capacity;
+    map->num_of_deleted = 0;
+    map->control = mem_alloc(sizeof(int8_t) * capacity);
+    map->slots = mem_alloc(sizeof(map_slot_t) * capacity);
+    memset(map->control, MAP_EMPTY, sizeof(int8_t) * capacity);
+}
+
+// Moves every key into new slots of the given capacity, which also
+// drops the deleted markers.
+static void rehash_map(dstr_map_t *map, size_t capacity)
+{
+    int8_t *old_control = map->control;
+    map_slot_t *old_slots = map->slots;
+    size_t old_capacity = map->capacity;
+
+    setup_map_slots(map, capacity);
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_control[i] >= 0)
+        {
+            uint64_t hash = get_dstr_hash(old_slots[i].key);
+            size_t j = find_free_map_slot(map, hash);
+
+            map->control[j] = get_map_tag(hash);
+            map->slots[j] = old_slots[i];
+        }
+    }
+
+    mem_free(old_control, sizeof(int8_t) * old_capacity);
+    mem_free(old_slots, sizeof(map_slot_t) * old_capacity);
+}
+
+// The smallest capacity that keeps size keys at most 7/8 full.
+static size_t get_map_capacity(size_t size)
+{
+    size_t capacity = MAP_GROUP_SIZE;
+
+    while ((size * 8) > (capacity * 7))
+    {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+static bool set_map_value(dstr_map_t *map, const char *key, size_t size, uint64_t hash, void *value)
+{
+    map_slot_t *slot = find_map_slot(map, key, size, hash);
+
+    if (slot != NULL)
+    {
+        slot->value = value;
+        return false;
+    }
+
+    if (((map->size + map->num_of_deleted + 1) * 8) > (map->capacity * 7))
+    {
+        // Grows when the keys fill half of it, otherwise
+        // this only clears out the deleted markers.
+        rehash_map(map, ((map->size + 1) * 2 > map->capacity) ? map->capacity * 2 : map->capacity);
+    }
+
+    size_t i = find_free_map_slot(map, hash);
+
+    if (map->control[i] == MAP_DELETED)
+    {
+        map->num_of_deleted--;
+    }
+
+    map->control[i] = get_map_tag(hash);
+    map->slots[i].key = alloc_sized_dstr(key, size);
+    map->slots[i].key->hash = hash;
+    map->slots[i].key->is_hash_cached = true;
+    map->slots[i].value = value;
+    map->size++;
+
+    return true;
+}
+
+static bool erase_map_key(dstr_map_t *map, const char *key, size_t size, uint64_t hash)
+{
+    map_slot_t *slot = find_map_slot(map, key, size, hash);
+
+    if (slot == NULL)
+    {
+        return false;
+    }
+
+    size_t i = (size_t)(slot - map->slots);
+    const int8_t *control = &map->control[(i / MAP_GROUP_SIZE) * MAP_GROUP_SIZE];
+
+    // Probes stop at a group with an empty slot, so no key can
+    // be behind this one and it can be marked empty too.
+    if (match_map_group(control, MAP_EMPTY) != 0)
+    {
+        map->control[i] = MAP_EMPTY;
+    }
+    else
+    {
+        map->control[i] = MAP_DELETED;
+        map->num_of_deleted++;
+    }
+
+    dstr_free(&slot->key);
+    map->size--;
+
+    return true;
+}
+
+// Parses pattern[0, size) into a segment. A backslash
+// escapes the byte after it, '?' matches any byte.
+static void setup_glob_segment(glob_segment_t *segment, const char *pattern, size_t size)
+{
+    size_t i = 0;
+    size_t num_of_escapes = 0;
+
+    for (size_t j = 0; j + 1 < size; j++)
+    {
+        if (pattern[j] == '\\')
+        {
+            num_of_escapes++;
+            j++;
+        }
+    }
+
+    segment->size = 0;
+    segment->data = mem_alloc(sizeof(char) * (size - num_of_escapes + 1));
+    segment->is_any = mem_alloc(sizeof(bool) * (size - num_of_escapes + 1));
+
+    while (i < size)
+    {
+        if (pattern[i] == '\\' && i + 1 < size)
+        {
+            i++;
+            segment->is_any[segment->size] = false;
+        }
+        else
+        {
+            segment->is_any[segment->size] = (pattern[i] == '?');
+        }
+
+        segment->data[segment->size++] = pattern[i++];
+    }
+
+    // Last wildcard before the final position, every byte can match there.
+    size_t any_shift = segment->size;
+
+    for (size_t j = 0; j + 1 < segment->size; j++)
+    {
+        if (segment->is_any[j])
+        {
+            any_shift = segment->size - 1 - j;
+        }
+    }
+
+    for (size_t c = 0; c < 256; c++)
+    {
+        segment->shift[c] = any_shift;
+    }
+
+    for (size_t j = 0; j + 1 < segment->size; j++)
+    {
+        size_t shift = segment->size - 1 - j;
+        unsigned char c = (unsigned char)segment->data[j];
+
+        if (!(segment->is_any[j]) && shift < segment->shift[c])
+        {
+            segment->shift[c] = shift;
+        }
+    }
+}
+
+static bool is_glob_segment_at(glob_segment_t *segment, const char *data)
+{
+    for (size_t i = segment->size; i > 0; i--)
+    {
+        if (data[i-1] != segment->data[i-1] && !(segment->is_any[i-1]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Horspool search of a segment in data[0, size).
+static const char *find_glob_segment(glob_segment_t *segment, const char *data, size_t size)
+{
+    if (segment->size > size)
+    {
+        return NULL;
+    }
+
+    size_t i = 0;
+    size_t last = size - segment->size;
+
+    while (i <= last)
+    {
+        if (is_glob_segment_at(segment, &data[i]))
+        {
+            return &data[i];
+        }
+
+        i += segment->shift[(unsigned char)data[i + segment->size - 1]];
+    }
+
+    return NULL;
+}
+
+// Segments between stars are matched greedily at their leftmost position,
+// which is always safe for '*' patterns, so there is no backtracking.
+static bool is_glob_match(dstr_glob_t *glob, const char *data, size_t size)
+{
+    if (size < glob->min_size)
+    {
+        return false;
+    }
+
+    glob_segment_t *prefix = &glob->segments[0];
+
+    if (!(glob->has_star))
+    {
+        return (size == prefix->size && is_glob_segment_at(prefix, data));
+    }
+
+    glob_segment_t *suffix = &glob->segments[glob->size - 1];
+
+    if (!(is_glob_segment_at(prefix, data))
+        || !(is_glob_segment_at(suffix, &data[size - suffix->size])))
+    {
+        return false;
+    }
+
+    const char *copy = data + prefix->size;
+    const char *end = data + size - suffix->size;
+
+    for (size_t i = 1; i + 1 < glob->size; i++)
+    {
+        const char *found = find_glob_segment(&glob->segments[i], copy, (size_t)(end - copy));
+
+        if (found == NULL)
+        {
+            return false;
+        }
+
+        copy = found + glob->segments[i].size;
+    }
+
+    return true;
+}
+
+static bool is_equal_nocase(const char *data, const char *search_val, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (ascii_lower(data[i]) != ascii_lower(search_val[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ASCII case-insensitive search. Candidates are found by comparing
+// (byte | 0x20) with the folded first byte of search_val, this also lets
+// through some punctuation (like '@' for '`'), so each candidate is verified.
+static const char *find_nocase(const char *data, size_t size, const char *search_val, size_t search_val_size)
+{
+    if (search_val_size == 0 || search_val_size > size)
+    {
+        return NULL;
+    }
+
+    size_t i = 0;
+    size_t last = size - search_val_size;
+    char first = (char)(search_val[0] | 0x20);
+
+#if defined(__SSE2__)
+    const __m128i fold = _mm_set1_epi8(0x20);
+    const __m128i target = _mm_set1_epi8(first);
+
+    while (i + 16 <= last + 1)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&data[i]);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(block, fold), target));
+
+        while (mask != 0)
+        {
+            size_t candidate = i + (size_t)__builtin_ctz(mask);
+
+            if (is_equal_nocase(&data[candidate], search_val, search_val_size))
+            {
+                return &data[candidate];
+            }
+
+            mask &= mask - 1;
+        }
+
+        i += 16;
+    }
+#endif
+
+    while (i <= last)
+    {
+        if ((char)(data[i] | 0x20) == first
+            && is_equal_nocase(&data[i], search_val, search_val_size))
+        {
+            return &data[i];
+        }
+
+        i++;
+    }
+
+    return NULL;
+}
+
+static size_t count_occurrences_nocase(const char *data, size_t size, const char *search_val, size_t count)
+{
+    size_t occurrences = 0;
+    size_t search_val_size = strlen(search_val);
+    const char *end = data + size;
+    const char *found = find_nocase(data, size, search_val, search_val_size);
+
+    while (found != NULL && (count == 0 || occurrences < count))
+    {
+        occurrences++;
+        found += search_val_size;
+        found = find_nocase(found, (size_t)(end - found), search_val, search_val_size);
+    }
+
+    return occurrences;
+}
+
+// Grows the buffer of a dstr so it fits size chars, keeping its content.
+static void reserve_dstr_data(dstr_t *dstr, size_t size)
+{
+    if (size > dstr->capacity)
+    {
+        size_t capacity = update_capacity(size, dstr->capacity);
+        set_dstr_data(dstr, mem_realloc(dstr->data, sizeof(char) * (dstr->capacity + 1), sizeof(char) * (capacity + 1)), capacity);
+    }
+}
+
+// Reads the rest of a stream onto the end of a dstr, straight into its spare
+// capacity, and doubles the buffer whenever it fills up.
+static void append_stream(dstr_t *dstr, FILE *fp)
+{
+    size_t size = dstr->size;
+
+    invalidate_cached(dstr);
+
+    while (true)
+    {
+        reserve_dstr_data(dstr, size + 1);
+
+        size_t num_of_read = fread(&dstr->data[size], sizeof(char), dstr->capacity - size, fp);
+        size += num_of_read;
+
+        if (num_of_read == 0)
+        {
+            break;
+        }
+    }
+
+    dstr->data[size] = '\0';
+    set_dstr_size(dstr, size);
+}
+
+// Reads the next line of a stream onto the end of a dstr, newline included.
+// Returns false when the stream has nothing left to read.
+static bool append_stream_line(dstr_t *dstr, FILE *fp)
+{
+    size_t size = dstr->size;
+    int letter;
+
+    invalidate_cached(dstr);
+
+    // Reads byte by byte instead of with fgets, so a '\0' in the line is
+    // kept and counted like any other byte.
+    flockfile(fp);
+
+    while ((letter = getc_unlocked(fp)) != EOF)
+    {
+        if (size == dstr->capacity)
+        {
+            reserve_dstr_data(dstr, size + 1);
+        }
+
+        dstr->data[size++] = (char)letter;
+
+        if (letter == '\n')
+        {
+            break;
+        }
+    }
+
+    funlockfile(fp);
+
+    bool is_read = (size > dstr->size);
+
+    dstr->data[size] = '\0';
+    set_dstr_size(dstr, size);
+
+    return is_read;
+}
+
+// Replaces the content of a dstr with the next line of a stream, without its newline.
+// The buffer is kept between calls, so reading lines only allocates when one
+// is longer than every line before it.
+static bool read_stream_line(dstr_t *dstr, FILE *fp)
+{
+    set_dstr_size(dstr, 0);
+
+    if (!append_stream_line(dstr, fp))
+    {
+        return false;
+    }
+
+    if (dstr->data[dstr->size - 1] == '\n')
+    {
+        set_dstr_size(dstr, dstr->size - 1);
+        dstr->data[dstr->size] = '\0';
+    }
+
+    return true;
+}
+
+// Reads a text stream, ending the last line with a newline if it has none.
+static dstr_t *alloc_read_file_content(FILE *fp)
+{
+    if (fp == NULL) 
+    {
+        printf("%s: %swarning:%s failed to read content%s\n", __func__, PURPLE, WHITE, RESET);
+        return NULL;
+    }
+
+    dstr_t *dstr = alloc_dstr();
+
+    set_empty_dstr(dstr);
+    append_stream(dstr, fp);
+
+    if (dstr->size > 0 && dstr->data[dstr->size - 1] != '\n')
+    {
+        reserve_dstr_data(dstr, dstr->size + 1);
+        dstr->data[dstr->size] = '\n';
+        dstr->data[dstr->size + 1] = '\0';
+        set_dstr_size(dstr, dstr->size + 1);
+    }
+
+    return dstr;
+}
+
+// Children of dstr_proc_run_many and dstr_proc_stream_many. At most
+// PROC_MAX_RUNNING of them run at once, and each has a slot with two
+// poll entries, one for its stdout pipe and one for its stderr pipe.
+// A closed pipe has fd -1, which poll skips.
+typedef struct proc_runner
+{
+    const char **cmds;
+    size_t num_of_cmds;
+    size_t next_cmd;
+    size_t num_of_running;
+    int *exit_statuses;
+    dstr_proc_result_t *results;
+    void (*func)(size_t cmd_index, bool is_error, const char *data, size_t size, void *context);
+    void *context;
+    char *buffer;
+    pid_t pids[PROC_MAX_RUNNING];
+    size_t slot_cmds[PROC_MAX_RUNNING];
+    struct pollfd fds[PROC_MAX_RUNNING * 2];
+} proc_runner_t;
+
+// pipe2 sets close-on-exec atomically. With pipe and fcntl a process
+// spawned by another thread in between would inherit the write end, and
+// the read end wouldn't see EOF until that process exits.
+static bool alloc_cloexec_pipe(int fds[2])
+{
+#if defined(__linux__)
+    return (pipe2(fds, O_CLOEXEC) == 0);
+#else
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+
+    if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) == -1
+        || fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+static void close_pipe(int fds[2])
+{
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Runs cmd with /bin/sh like popen does, with stdout and stderr going to
+// the write ends of the pipes. Returns -1 if the child can't be started.
+static pid_t spawn_shell(const char *cmd, int output_fd, int error_fd)
+{
+    posix_spawn_file_actions_t actions;
+    char *argv[] = {"sh", "-c", (char*)cmd, NULL};
+    pid_t pid = -1;
+
+    if (posix_spawn_file_actions_init(&actions) != 0)
+    {
+        return -1;
+    }
+
+    // dup2 clears close-on-exec on the new fds, the pipe ends themselves
+    // are closed in the child by the exec.
+    if (posix_spawn_file_actions_adddup2(&actions, output_fd, STDOUT_FILENO) != 0
+        || posix_spawn_file_actions_adddup2(&actions, error_fd, STDERR_FILENO) != 0
+        || posix_spawn(&pid, "/bin/sh", &actions, NULL, argv, environ) != 0)
+    {
+        pid = -1;
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    return pid;
+}
+
+// Same numbers a shell would give: the exit code, or 128 + the signal.
+static int get_exit_status(int status)
+{
+    if (WIFEXITED(status))
+    {
+        return WEXITSTATUS(status);
+    }
+
+    if (WIFSIGNALED(status))
+    {
+        return 128 + WTERMSIG(status);
+    }
+
+    return -1;
+}
+
+static void set_exit_status(proc_runner_t *runner, size_t cmd_index, int exit_status)
+{
+    if (runner->exit_statuses != NULL)
+    {
+        runner->exit_statuses[cmd_index] = exit_status;
+    }
+
+    if (runner->results != NULL)
+    {
+        runner->results[cmd_index].exit_status = exit_status;
+    }
+}
+
+// Starts the next command in a free slot. A command that can't be
+// started gets exit status -1 and no output.
+static void start_next_proc(proc_runner_t *runner, size_t slot)
+{
+    size_t cmd_index = runner->next_cmd++;
+    int output_pipe[2];
+    int error_pipe[2];
+
+    if (!alloc_cloexec_pipe(output_pipe))
+    {
+        set_exit_status(runner, cmd_index, -1);
+        return;
+    }
+
+    if (!alloc_cloexec_pipe(error_pipe))
+    {
+        close_pipe(output_pipe);
+        set_exit_status(runner, cmd_index, -1);
+        return;
+    }
+
+    pid_t pid = spawn_shell(runner->cmds[cmd_index], output_pipe[1], error_pipe[1]);
+
+    close(output_pipe[1]);
+    close(error_pipe[1]);
+
+    if (pid == -1)
+    {
+        close(output_pipe[0]);
+        close(error_pipe[0]);
+        set_exit_status(runner, cmd_index, -1);
+        return;
+    }
+
+    runner->pids[slot] = pid;
+    runner->slot_cmds[slot] = cmd_index;
+    runner->fds[slot * 2].fd = output_pipe[0];
+    runner->fds[slot * 2 + 1].fd = error_pipe[0];
+    runner->num_of_running++;
+}
+
+// Captured output is read straight into the spare capacity of the result
+// dstr, which doubles as it fills, so big outputs take big reads.
+static ssize_t read_proc_output(proc_runner_t *runner, size_t cmd_index, int fd, bool is_error)
+{
+    if (runner->results == NULL)
+    {
+        ssize_t num_of_read = read(fd, runner->buffer, PROC_READ_SIZE);
+
+        if (num_of_read > 0)
+        {
+            runner->func(cmd_index, is_error, runner->buffer, (size_t)num_of_read, runner->context);
+        }
+
+        return num_of_read;
+    }
+
+    dstr_t *dstr = is_error ? runner->results[cmd_index].error : runner->results[cmd_index].output;
+
+    reserve_dstr_data(dstr, dstr->size + PROC_MIN_READ_SIZE);
+
+    ssize_t num_of_read = read(fd, &dstr->data[dstr->size], dstr->capacity - dstr->size);
+
+    if (num_of_read > 0)
+    {
+        set_dstr_size(dstr, dstr->size + (size_t)num_of_read);
+        dstr->data[dstr->size] = '\0';
+    }
+
+    return num_of_read;
+}
+
+// A child is reaped once both of its pipes are closed, which frees its slot.
+static void read_proc_slot(proc_runner_t *runner, size_t slot)
+{
+    size_t cmd_index = runner->slot_cmds[slot];
+
+    for (size_t i = slot * 2; i < slot * 2 + 2; i++)
+    {
+        struct pollfd *entry = &runner->fds[i];
+
+        if (entry->fd == -1 || entry->revents == 0)
+        {
+            continue;
+        }
+
+        ssize_t num_of_read = read_proc_output(runner, cmd_index, entry->fd, (i % 2) == 1);
+
+        if (num_of_read == 0 || (num_of_read < 0 && errno != EINTR && errno != EAGAIN))
+        {
+            close(entry->fd);
+            entry->fd = -1;
+        }
+    }
+
+    if (runner->fds[slot * 2].fd == -1 && runner->fds[slot * 2 + 1].fd == -1)
+    {
+        int status = 0;
+
+        while (waitpid(runner->pids[slot], &status, 0) == -1 && errno == EINTR);
+
+        set_exit_status(runner, cmd_index, get_exit_status(status));
+        runner->pids[slot] = -1;
+        runner->num_of_running--;
+    }
+}
+
+// poll only fails on bad arguments or without memory, and then none of the
+// output can be read. The running children are closed off and reaped, and
+// every command that hasn't finished gets exit status -1.
+static void abort_procs(proc_runner_t *runner)
+{
+    for (size_t i = 0; i < PROC_MAX_RUNNING; i++)
+    {
+        if (runner->pids[i] == -1)
+        {
+            continue;
+        }
+
+        for (size_t j = i * 2; j < i * 2 + 2; j++)
+        {
+            if (runner->fds[j].fd != -1)
+            {
+                close(runner->fds[j].fd);
+                runner->fds[j].fd = -1;
+            }
+        }
+
+        while (waitpid(runner->pids[i], NULL, 0) == -1 && errno == EINTR);
+
+        set_exit_status(runner, runner->slot_cmds[i], -1);
+        runner->pids[i] = -1;
+        runner->num_of_running--;
+    }
+
+    while (runner->next_cmd < runner->num_of_cmds)
+    {
+        set_exit_status(runner, runner->next_cmd++, -1);
+    }
+}
+
+static void run_procs(proc_runner_t *runner)
+{
+    for (size_t i = 0; i < PROC_MAX_RUNNING; i++)
+    {
+        runner->pids[i] = -1;
+        runner->fds[i * 2].fd = -1;
+        runner->fds[i * 2 + 1].fd = -1;
+        runner->fds[i * 2].events = POLLIN;
+        runner->fds[i * 2 + 1].events = POLLIN;
+    }
+
+    while (runner->next_cmd < runner->num_of_cmds || runner->num_of_running > 0)
+    {
+        for (size_t i = 0; i < PROC_MAX_RUNNING && runner->next_cmd < runner->num_of_cmds; i++)
+        {
+            if (runner->pids[i] == -1)
+            {
+                start_next_proc(runner, i);
+            }
+        }
+
+        if (runner->num_of_running == 0)
+        {
+            continue;
+        }
+
+        if (poll(runner->fds, PROC_MAX_RUNNING * 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            abort_procs(runner);
+            break;
+        }
+
+        for (size_t i = 0; i < PROC_MAX_RUNNING; i++)
+        {
+            if (runner->pids[i] != -1)
+            {
+                read_proc_slot(runner, i);
+            }
+        }
+    }
+}
+
+// One file of dstr_arr_read_files. The dstr is allocated on whichever
+// thread reads the file and is always left valid, empty when the read fails.
+typedef struct file_task
+{
+    const char *path;
+    bool is_binary;
+    bool is_failed;
+    dstr_t *dstr;
+} file_task_t;
+
+// Reads a whole file with plain read calls. The buffer is sized from fstat,
+// so a regular file takes one allocation of its exact size, and it grows
+// only for files whose size isn't known up front, like pipes or /proc files.
+static bool read_fd_content(int fd, dstr_t *dstr, size_t extra_size)
+{
+    struct stat file_stat;
+    size_t file_size = 0;
+    size_t size = 0;
+    bool is_read = true;
+
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+    {
+        file_size = (size_t)file_stat.st_size;
+    }
+
+    size_t capacity = (file_size > 0) ? file_size + extra_size : DEFAULT_CAPACITY;
+    set_dstr_data(dstr, alloc_dstr_data(capacity), capacity);
+
+    while (file_size == 0 || size < file_size)
+    {
+        if (file_size == 0)
+        {
+            reserve_dstr_data(dstr, size + extra_size + 1);
+        }
+
+        ssize_t num_of_read = read(fd, &dstr->data[size], dstr->capacity - extra_size - size);
+
+        if (num_of_read == 0)
+        {
+            break;
+        }
+        else if (num_of_read < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            size = 0;
+            is_read = false;
+            break;
+        }
+
+        size += (size_t)num_of_read;
+    }
+
+    dstr->data[size] = '\0';
+    set_dstr_size(dstr, size);
+
+    return is_read;
+}
+
+// Text files end with a newline, like alloc_read_file_content makes them.
+static void read_file_task(void *data)
+{
+    file_task_t *task = data;
+    int fd = open(task->path, O_RDONLY | O_CLOEXEC);
+
+    task->dstr = alloc_dstr();
+
+    if (fd == -1)
+    {
+        set_empty_dstr(task->dstr);
+        task->is_failed = true;
+        return;
+    }
+
+    task->is_failed = !read_fd_content(fd, task->dstr, task->is_binary ? 0 : 1);
+    close(fd);
+
+    dstr_t *dstr = task->dstr;
+
+    if (!task->is_binary && dstr->size > 0 && dstr->data[dstr->size - 1] != '\n')
+    {
+        dstr->data[dstr->size] = '\n';
+        dstr->data[dstr->size + 1] = '\0';
+        set_dstr_size(dstr, dstr->size + 1);
+    }
+}
+
+// Lists the changed bytes for the SIMD path, or leaves the counts past
+// TRANS_MAX_SIMD_BYTES so dstr_translate falls back to the table.
+static void setup_trans_bytes(dstr_trans_t *trans)
+{
+    for (size_t i = 0; i < 256; i++)
+    {
+        if (trans->is_deleted[i])
+        {
+            if (trans->num_of_deleted < TRANS_MAX_SIMD_BYTES)
+            {
+                trans->deleted[trans->num_of_deleted] = (unsigned char)i;
+            }
+
+            trans->num_of_deleted++;
+        }
+        else if (trans->map[i] != i)
+        {
+            if (trans->num_of_pairs < TRANS_MAX_SIMD_BYTES)
+            {
+                trans->from[trans->num_of_pairs] = (unsigned char)i;
+                trans->to[trans->num_of_pairs] = trans->map[i];
+            }
+
+            trans->num_of_pairs++;
+        }
+    }
+}
+
+// Maps and compacts in place, writing at write_index which never passes
+// the read index, so no other buffer is needed. Returns the new size.
+static size_t translate_str(dstr_trans_t *trans, char *data, size_t size)
+{
+    size_t read_index = 0;
+    size_t write_index = 0;
+
+#if defined(__SSE2__)
+    if (trans->num_of_pairs <= TRANS_MAX_SIMD_BYTES && trans->num_of_deleted <= TRANS_MAX_SIMD_BYTES)
+    {
+        __m128i from[TRANS_MAX_SIMD_BYTES];
+        __m128i to[TRANS_MAX_SIMD_BYTES];
+        __m128i deleted[TRANS_MAX_SIMD_BYTES];
+
+        for (size_t i = 0; i < trans->num_of_pairs; i++)
+        {
+            from[i] = _mm_set1_epi8((char)trans->from[i]);
+            to[i] = _mm_set1_epi8((char)trans->to[i]);
+        }
+
+        for (size_t i = 0; i < trans->num_of_deleted; i++)
+        {
+            deleted[i] = _mm_set1_epi8((char)trans->deleted[i]);
+        }
+
+        while (read_index + 16 <= size)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i*)&data[read_index]);
+            __m128i result = block;
+            __m128i is_deleted = _mm_setzero_si128();
+
+            for (size_t i = 0; i < trans->num_of_pairs; i++)
+            {
+                __m128i is_match = _mm_cmpeq_epi8(block, from[i]);
+                result = _mm_or_si128(_mm_andnot_si128(is_match, result), _mm_and_si128(is_match, to[i]));
+            }
+
+            for (size_t i = 0; i < trans->num_of_deleted; i++)
+            {
+                is_deleted = _mm_or_si128(is_deleted, _mm_cmpeq_epi8(block, deleted[i]));
+            }
+
+            int mask = _mm_movemask_epi8(is_deleted);
+
+            if (mask == 0)
+            {
+                _mm_storeu_si128((__m128i*)&data[write_index], result);
+                write_index += 16;
+            }
+            else
+            {
+                char bytes[16];
+                _mm_storeu_si128((__m128i*)bytes, result);
+
+                for (int i = 0; i < 16; i++)
+                {
+                    data[write_index] = bytes[i];
+                    write_index += (size_t)(((mask >> i) & 1) ^ 1);
+                }
+            }
+
+            read_index += 16;
+        }
+    }
+#endif
+
+    while (read_index < size)
+    {
+        unsigned char letter = (unsigned char)data[read_index++];
+
+        data[write_index] = (char)trans->map[letter];
+        write_index += !trans->is_deleted[letter];
+    }
+
+    return write_index;
+}
+
+static uint8_t get_byte_classes(unsigned char letter)
+{
+    if (letter >= '0' && letter <= '9')
+    {
+        return DSTR_CLASS_DIGIT | DSTR_CLASS_ALNUM | DSTR_CLASS_ASCII;
+    }
+    else if (letter >= 'A' && letter <= 'Z')
+    {
+        return DSTR_CLASS_UPPER | DSTR_CLASS_ALPHA | DSTR_CLASS_ALNUM | DSTR_CLASS_ASCII;
+    }
+    else if (letter >= 'a' && letter <= 'z')
+    {
+        return DSTR_CLASS_LOWER | DSTR_CLASS_ALPHA | DSTR_CLASS_ALNUM | DSTR_CLASS_ASCII;
+    }
+    else if (letter == ' ' || (letter >= '\t' && letter <= '\r'))
+    {
+        return DSTR_CLASS_SPACE | DSTR_CLASS_ASCII;
+    }
+
+    return (letter < 0x80) ? DSTR_CLASS_ASCII : 0;
+}
+
+#if defined(__SSE2__)
+// Marks the bytes in [low, high]. Adding 0x80 - low moves the range to
+// start at -128, so one signed compare checks both ends.
+static __m128i get_range_bytes(__m128i block, unsigned char low, unsigned char high)
+{
+    __m128i shifted = _mm_add_epi8(block, _mm_set1_epi8((char)(0x80 - low)));
+
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + (high - low) + 1)));
+}
+#endif
+
+// A class is known not to hold once a byte failed it, and upper or lower
+// once a letter of the other case was seen.
+static bool is_classes_known(uint8_t failed, bool has_upper, bool has_lower, uint8_t wanted)
+{
+    uint8_t known = failed | (has_lower ? DSTR_CLASS_UPPER : 0) | (has_upper ? DSTR_CLASS_LOWER : 0);
+
+    return (known & wanted) == wanted;
+}
+
+// Returns the DSTR_CLASS_* bits the whole str belongs to. All of them are
+// found in one pass, which stops once every class in wanted is known not
+// to hold, so a predicate returns false at the first block that fails it.
+// upper and lower follow Python: there has to be a cased letter, and
+// none of the other case.
+static uint8_t get_str_classes(const char *data, size_t size, uint8_t wanted)
+{
+    const uint8_t all_bytes_classes = DSTR_CLASS_DIGIT | DSTR_CLASS_ALPHA | DSTR_CLASS_ALNUM | DSTR_CLASS_SPACE | DSTR_CLASS_ASCII;
+    uint8_t failed = 0;
+    bool has_upper = false;
+    bool has_lower = false;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    while (i + 16 <= size && !is_classes_known(failed, has_upper, has_lower, wanted))
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&data[i]);
+        int digits = _mm_movemask_epi8(get_range_bytes(block, '0', '9'));
+        int uppers = _mm_movemask_epi8(get_range_bytes(block, 'A', 'Z'));
+        int lowers = _mm_movemask_epi8(get_range_bytes(block, 'a', 'z'));
+        int spaces = _mm_movemask_epi8(_mm_or_si128(get_range_bytes(block, '\t', '\r'), _mm_cmpeq_epi8(block, _mm_set1_epi8(' '))));
+
+        failed |= (digits != 0xFFFF) ? DSTR_CLASS_DIGIT : 0;
+        failed |= ((uppers | lowers) != 0xFFFF) ? DSTR_CLASS_ALPHA : 0;
+        failed |= ((uppers | lowers | digits) != 0xFFFF) ? DSTR_CLASS_ALNUM : 0;
+        failed |= (spaces != 0xFFFF) ? DSTR_CLASS_SPACE : 0;
+        failed |= (_mm_movemask_epi8(block) != 0) ? DSTR_CLASS_ASCII : 0;
+        has_upper = has_upper || (uppers != 0);
+        has_lower = has_lower || (lowers != 0);
+        i += 16;
+    }
+#endif
+
+    for (; i < size && !is_classes_known(failed, has_upper, has_lower, wanted); i++)
+    {
+        uint8_t classes = get_byte_classes((unsigned char)data[i]);
+
+        failed |= (uint8_t)(~classes & all_bytes_classes);
+        has_upper = has_upper || (classes & DSTR_CLASS_UPPER);
+        has_lower = has_lower || (classes & DSTR_CLASS_LOWER);
+    }
+
+    if (size == 0)
+    {
+        return DSTR_CLASS_ASCII;
+    }
+
+    uint8_t classes = (uint8_t)(~failed & all_bytes_classes);
+
+    classes |= (has_upper && !has_lower) ? DSTR_CLASS_UPPER : 0;
+    classes |= (has_lower && !has_upper) ? DSTR_CLASS_LOWER : 0;
+
+    return classes;
+}
+
+// Bytes are summed as unsigned, so the total doesn't depend on whether char is signed.
+static size_t sum_bytes(const char *data, size_t size)
+{
+    size_t total = 0;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // psadbw adds up 8 bytes at a time into the two 64-bit halves.
+    __m128i sums = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+
+    while (i + 16 <= size)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&data[i]);
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(block, zero));
+        i += 16;
+    }
+
+    total = (size_t)_mm_cvtsi128_si64(sums) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+#endif
+
+    for (; i < size; i++)
+    {
+        total += (unsigned char)data[i];
+    }
+
+    return total;
+}
+
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+// Tables for slicing by 8, table[k][b] is the crc of byte b followed by k zero bytes.
+static void setup_crc32c_table(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+
+        crc32c_table[0][i] = crc;
+    }
+
+    for (size_t i = 0; i < 256; i++)
+    {
+        for (size_t k = 1; k < 8; k++)
+        {
+            uint32_t previous = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (previous >> 8) ^ crc32c_table[0][previous & 0xFF];
+        }
+    }
+}
+
+static uint32_t update_crc32c_table(uint32_t crc, const char *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+
+    pthread_once(&crc32c_table_once, setup_crc32c_table);
+
+    while (size >= 8)
+    {
+        uint32_t low = crc ^ ((uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+
+        crc = crc32c_table[7][low & 0xFF] ^ crc32c_table[6][(low >> 8) & 0xFF]
+            ^ crc32c_table[5][(low >> 16) & 0xFF] ^ crc32c_table[4][low >> 24]
+            ^ crc32c_table[3][bytes[4]] ^ crc32c_table[2][bytes[5]]
+            ^ crc32c_table[1][bytes[6]] ^ crc32c_table[0][bytes[7]];
+        bytes += 8;
+        size -= 8;
+    }
+
+    while (size > 0)
+    {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *bytes) & 0xFF];
+        bytes++;
+        size--;
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+// The crc32 instruction is SSE4.2, so this only runs after checking the cpu has it.
+__attribute__((target("sse4.2")))
+static uint32_t update_crc32c_sse42(uint32_t crc, const char *data, size_t size)
+{
+    uint64_t crc64 = crc;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, &data[i], sizeof(uint64_t));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t)crc64;
+
+    for (; i < size; i++)
+    {
+        crc = _mm_crc32_u8(crc, (unsigned char)data[i]);
+    }
+
+    return crc;
+}
+#endif
+
+// crc is a finished crc32c of the data before, 0 at the start.
+static uint32_t update_crc32c(uint32_t crc, const char *data, size_t size)
+{
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return ~update_crc32c_sse42(crc, data, size);
+    }
+#endif
+
+    return ~update_crc32c_table(crc, data, size);
+}
+
+static size_t get_snapshot_size(dstr_arr_t *dstr_array, size_t *blob_size)
+{
+    *blob_size = 0;
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        *blob_size += dstr_array->data_set[i]->size + 1;
+    }
+
+    return sizeof(snapshot_header_t) + (dstr_array->size + 1) * sizeof(uint64_t) + *blob_size;
+}
+
+// Fills a mapped snapshot file, the checksum last since it covers everything after the header.
+static void fill_snapshot(char *map, dstr_arr_t *dstr_array, size_t blob_size)
+{
+    snapshot_header_t header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, SNAPSHOT_BYTE_ORDER, dstr_array->size, blob_size, 0};
+    uint64_t *offsets = (uint64_t*)(map + sizeof(snapshot_header_t));
+    char *blob = (char*)(offsets + dstr_array->size + 1);
+    size_t offset = 0;
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        dstr_t *dstr = dstr_array->data_set[i];
+
+        offsets[i] = offset;
+        memcpy(&blob[offset], dstr->data, dstr->size);
+        blob[offset + dstr->size] = '\0';
+        offset += dstr->size + 1;
+    }
+
+    offsets[dstr_array->size] = offset;
+    header.checksum = update_crc32c(0, (char*)offsets, (dstr_array->size + 1) * sizeof(uint64_t) + blob_size);
+    memcpy(map, &header, sizeof(snapshot_header_t));
+}
+
+// Only checks the header and the ends of the offsets, so opening doesn't
+// touch every page of the file. Each element is checked when it is read.
+static bool is_valid_snapshot_header(const char *map, size_t map_size)
+{
+    snapshot_header_t header;
+
+    if (map_size < sizeof(snapshot_header_t) + sizeof(uint64_t))
+    {
+        return false;
+    }
+
+    memcpy(&header, map, sizeof(snapshot_header_t));
+
+    size_t max_elements = (map_size - sizeof(snapshot_header_t)) / sizeof(uint64_t) - 1;
+
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SNAPSHOT_VERSION
+        || header.byte_order != SNAPSHOT_BYTE_ORDER
+        || header.num_of_elements > max_elements)
+    {
+        return false;
+    }
+
+    size_t table_size = ((size_t)header.num_of_elements + 1) * sizeof(uint64_t);
+    const uint64_t *offsets = (const uint64_t*)(map + sizeof(snapshot_header_t));
+
+    return header.blob_size == map_size - sizeof(snapshot_header_t) - table_size
+        && offsets[0] == 0
+        && offsets[header.num_of_elements] == header.blob_size;
+}
+
+// Checks everything a view of element index relies on, so a corrupt
+// file fails here instead of being read out of bounds.
+static bool is_valid_snapshot_element(dstr_snapshot_t *snapshot, size_t index)
+{
+    uint64_t start = snapshot->offsets[index];
+    uint64_t end = snapshot->offsets[index + 1];
+
+    return start < end && end <= snapshot->blob_size && snapshot->blob[end - 1] == '\0';
+}
+
+static const uint64_t digest_primes[5] = {0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL,
+                                          0x85EBCA77C2B2AE63ULL, 0x27D4EB2F165667C5ULL};
+
+static uint64_t rotate_left(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t digest_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * digest_primes[1];
+    accumulator = rotate_left(accumulator, 31);
+
+    return accumulator * digest_primes[0];
+}
+
+static void setup_digest(dstr_digest_t *digest, uint64_t seed)
+{
+    digest->seed = seed;
+    digest->accumulators[0] = seed + digest_primes[0] + digest_primes[1];
+    digest->accumulators[1] = seed + digest_primes[1];
+    digest->accumulators[2] = seed;
+    digest->accumulators[3] = seed - digest_primes[0];
+    digest->total_size = 0;
+    digest->buffer_size = 0;
+}
+
+static void digest_stripe(dstr_digest_t *digest, const unsigned char *stripe)
+{
+    for (size_t i = 0; i < 4; i++)
+    {
+        digest->accumulators[i] = digest_round(digest->accumulators[i], read_u64((const char*)&stripe[i * 8]));
+    }
+}
+
+static void update_digest(dstr_digest_t *digest, const char *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+
+    digest->total_size += size;
+
+    if (digest->buffer_size > 0)
+    {
+        size_t fill_size = DIGEST_STRIPE_SIZE - digest->buffer_size;
+
+        if (size < fill_size)
+        {
+            memcpy(&digest->buffer[digest->buffer_size], bytes, size);
+            digest->buffer_size += size;
+            return;
+        }
+
+        memcpy(&digest->buffer[digest->buffer_size], bytes, fill_size);
+        digest_stripe(digest, digest->buffer);
+        digest->buffer_size = 0;
+        bytes += fill_size;
+        size -= fill_size;
+    }
+
+    while (size >= DIGEST_STRIPE_SIZE)
+    {
+        digest_stripe(digest, bytes);
+        bytes += DIGEST_STRIPE_SIZE;
+        size -= DIGEST_STRIPE_SIZE;
+    }
+
+    memcpy(digest->buffer, bytes, size);
+    digest->buffer_size = size;
+}
+
+// Finishes a copy of the state, so more data can still be added after.
+static uint64_t get_digest(const dstr_digest_t *digest)
+{
+    const uint64_t *accumulators = digest->accumulators;
+    uint64_t hash;
+
+    if (digest->total_size >= DIGEST_STRIPE_SIZE)
+    {
+        hash = rotate_left(accumulators[0], 1) + rotate_left(accumulators[1], 7)
+             + rotate_left(accumulators[2], 12) + rotate_left(accumulators[3], 18);
+
+        for (size_t i = 0; i < 4; i++)
+        {
+            hash ^= digest_round(0, accumulators[i]);
+            hash = hash * digest_primes[0] + digest_primes[3];
+        }
+    }
+    else
+    {
+        hash = digest->seed + digest_primes[4];
+    }
+
+    hash += digest->total_size;
+
+    const unsigned char *bytes = digest->buffer;
+    size_t size = digest->buffer_size;
+
+    for (; size >= 8; bytes += 8, size -= 8)
+    {
+        hash ^= digest_round(0, read_u64((const char*)bytes));
+        hash = rotate_left(hash, 27) * digest_primes[0] + digest_primes[3];
+    }
+
+    if (size >= 4)
+    {
+        hash ^= read_u32((const char*)bytes) * digest_primes[0];
+        hash = rotate_left(hash, 23) * digest_primes[1] + digest_primes[2];
+        bytes += 4;
+        size -= 4;
+    }
+
+    for (; size > 0; bytes++, size--)
+    {
+        hash ^= *bytes * digest_primes[4];
+        hash = rotate_left(hash, 11) * digest_primes[0];
+    }
+
+    hash ^= hash >> 33;
+    hash *= digest_primes[1];
+    hash ^= hash >> 29;
+    hash *= digest_primes[2];
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+static uint64_t digest_str(const char *data, size_t size, uint64_t seed)
+{
+    dstr_digest_t digest;
+
+    setup_digest(&digest, seed);
+    update_digest(&digest, data, size);
+
+    return get_digest(&digest);
+}
+
+#if defined(__SSE2__)
+static __m128i get_escaped_bytes(__m128i block, escape_style_t style)
+{
+    if (style == ESCAPE_SHELL)
+    {
+        return _mm_cmpeq_epi8(block, _mm_set1_epi8('\''));
+    }
+
+    __m128i is_escaped = _mm_or_si128(get_range_bytes(block, 0x00, 0x1F),
+                                      _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                                                   _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))));
+
+    if (style == ESCAPE_C)
+    {
+        is_escaped = _mm_or_si128(is_escaped, _mm_cmpeq_epi8(block, _mm_set1_epi8(0x7F)));
+    }
+
+    return is_escaped;
+}
+#endif
+
+static bool is_escaped_byte(unsigned char letter, escape_style_t style)
+{
+    if (style == ESCAPE_SHELL)
+    {
+        return letter == '\'';
+    }
+
+    return letter < 0x20 || letter == '"' || letter == '\\' || (style == ESCAPE_C && letter == 0x7F);
+}
+
+// Returns the index of the first byte from start on that needs escaping, or size.
+static size_t find_escaped_byte(const char *data, size_t size, size_t start, escape_style_t style)
+{
+    size_t i = start;
+
+#if defined(__SSE2__)
+    while (i + 16 <= size)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&data[i]);
+        int mask = _mm_movemask_epi8(get_escaped_bytes(block, style));
+
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+
+        i += 16;
+    }
+#endif
+
+    while (i < size && !is_escaped_byte((unsigned char)data[i], style))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+// Writes the escape sequence of letter to escaped and returns its size.
+static size_t get_escape_sequence(unsigned char letter, escape_style_t style, char *escaped)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    const char *short_escapes = (style == ESCAPE_JSON) ? "\b\f\n\r\t\"\\" : "\a\b\f\n\r\t\v\"\\";
+    const char *short_letters = (style == ESCAPE_JSON) ? "bfnrt\"\\" : "abfnrtv\"\\";
+    const char *found = (letter != '\0') ? strchr(short_escapes, letter) : NULL;
+
+    if (style == ESCAPE_SHELL)
+    {
+        memcpy(escaped, "'\\''", 4);
+        return 4;
+    }
+    else if (found != NULL)
+    {
+        escaped[0] = '\\';
+        escaped[1] = short_letters[found - short_escapes];
+        return 2;
+    }
+    else if (style == ESCAPE_JSON)
+    {
+        memcpy(escaped, "\\u00", 4);
+        escaped[4] = hex_digits[letter >> 4];
+        escaped[5] = hex_digits[letter & 0xF];
+        return 6;
+    }
+
+    // Always three octal digits, so a digit after it can't be read as part of it.
+    escaped[0] = '\\';
+    escaped[1] = (char)('0' + (letter >> 6));
+    escaped[2] = (char)('0' + ((letter >> 3) & 7));
+    escaped[3] = (char)('0' + (letter & 7));
+    return 4;
+}
+
+// Sizes the output in one pass, then copies the clean runs between the
+// escaped bytes with memcpy. A dstr without anything to escape is left
+// as it is, apart from the quotes of ESCAPE_SHELL.
+static void escape_dstr(dstr_t *dstr, escape_style_t style)
+{
+    size_t quote_size = (style == ESCAPE_SHELL) ? 1 : 0;
+    size_t escaped_size = dstr->size + quote_size * 2;
+    size_t i = find_escaped_byte(dstr->data, dstr->size, 0, style);
+    char escaped[8];
+
+    if (i == dstr->size && quote_size == 0)
+    {
+        return;
+    }
+
+    while (i < dstr->size)
+    {
+        escaped_size += get_escape_sequence((unsigned char)dstr->data[i], style, escaped) - 1;
+        i = find_escaped_byte(dstr->data, dstr->size, i + 1, style);
+    }
+
+    size_t capacity = calculate_capacity(escaped_size);
+    char *data = alloc_dstr_data(capacity);
+    size_t size = 0;
+    size_t start = 0;
+
+    if (quote_size > 0)
+    {
+        data[size++] = '\'';
+    }
+
+    while (start < dstr->size)
+    {
+        i = find_escaped_byte(dstr->data, dstr->size, start, style);
+        memcpy(&data[size], &dstr->data[start], i - start);
+        size += i - start;
+
+        if (i < dstr->size)
+        {
+            size += get_escape_sequence((unsigned char)dstr->data[i], style, &data[size]);
+        }
+
+        start = i + 1;
+    }
+
+    if (quote_size > 0)
+    {
+        data[size++] = '\'';
+    }
+
+    data[size] = '\0';
+
+    invalidate_cached(dstr);
+    dstr_data_free(dstr);
+    set_dstr_data(dstr, data, capacity);
+    set_dstr_size(dstr, size);
+}
+
+static int get_hex_value(char letter)
+{
+    if (letter >= '0' && letter <= '9')
+    {
+        return letter - '0';
+    }
+    else if (letter >= 'a' && letter <= 'f')
+    {
+        return letter - 'a' + 10;
+    }
+    else if (letter >= 'A' && letter <= 'F')
+    {
+        return letter - 'A' + 10;
+    }
+
+    return -1;
+}
+
+// Reads exactly four hex digits, returns -1 if they aren't there.
+static int32_t read_hex4(const char *data, size_t size)
+{
+    int32_t value = 0;
+
+    if (size < 4)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < 4; i++)
+    {
+        int digit = get_hex_value(data[i]);
+
+        if (digit < 0)
+        {
+            return -1;
+        }
+
+        value = value * 16 + digit;
+    }
+
+    return value;
+}
+
+static size_t encode_utf8(uint32_t codepoint, char *data)
+{
+    if (codepoint < 0x80)
+    {
+        data[0] = (char)codepoint;
+        return 1;
+    }
+    else if (codepoint < 0x800)
+    {
+        data[0] = (char)(0xC0 | (codepoint >> 6));
+        data[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    else if (codepoint < 0x10000)
+    {
+        data[0] = (char)(0xE0 | (codepoint >> 12));
+        data[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        data[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+
+    data[0] = (char)(0xF0 | (codepoint >> 18));
+    data[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    data[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    data[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// Decodes the JSON escape after a backslash at data[0]. Returns how many
+// bytes it took, or 0 if it isn't valid, and writes its chars to decoded.
+static size_t decode_json_escape(const char *data, size_t size, char *decoded, size_t *decoded_size)
+{
+    const char *short_letters = "\"\\/bfnrt";
+    const char *short_escapes = "\"\\/\b\f\n\r\t";
+    const char *found = (size > 1 && data[1] != '\0') ? strchr(short_letters, data[1]) : NULL;
+
+    if (found != NULL)
+    {
+        decoded[0] = short_escapes[found - short_letters];
+        *decoded_size = 1;
+        return 2;
+    }
+    else if (size < 2 || data[1] != 'u')
+    {
+        return 0;
+    }
+
+    int32_t unit = read_hex4(&data[2], size - 2);
+
+    if (unit < 0 || (unit >= 0xDC00 && unit <= 0xDFFF))
+    {
+        return 0;
+    }
+    else if (unit < 0xD800 || unit > 0xDBFF)
+    {
+        *decoded_size = encode_utf8((uint32_t)unit, decoded);
+        return 6;
+    }
+
+    // A high surrogate has to be followed by an escaped low one.
+    if (size < 12 || data[6] != '\\' || data[7] != 'u')
+    {
+        return 0;
+    }
+
+    int32_t low_unit = read_hex4(&data[8], size - 8);
+
+    if (low_unit < 0xDC00 || low_unit > 0xDFFF)
+    {
+        return 0;
+    }
+
+    uint32_t codepoint = 0x10000 + (((uint32_t)unit - 0xD800) << 10) + ((uint32_t)low_unit - 0xDC00);
+    *decoded_size = encode_utf8(codepoint, decoded);
+
+    return 12;
+}
+
+// Decodes the C escape after a backslash at data[0], like decode_json_escape.
+static size_t decode_c_escape(const char *data, size_t size, char *decoded, size_t *decoded_size)
+{
+    const char *short_letters = "abfnrtv\\'\"?";
+    const char *short_escapes = "\a\b\f\n\r\t\v\\'\"?";
+    const char *found = (size > 1 && data[1] != '\0') ? strchr(short_letters, data[1]) : NULL;
+    unsigned int value = 0;
+    size_t i = 1;
+
+    *decoded_size = 1;
+
+    if (found != NULL)
+    {
+        decoded[0] = short_escapes[found - short_letters];
+        return 2;
+    }
+    else if (size > 1 && data[1] >= '0' && data[1] <= '7')
+    {
+        for (; i < size && i < 4 && data[i] >= '0' && data[i] <= '7'; i++)
+        {
+            value = value * 8 + (unsigned int)(data[i] - '0');
+        }
+    }
+    else if (size > 2 && data[1] == 'x' && get_hex_value(data[2]) >= 0)
+    {
+        for (i = 2; i < size && i < 4 && get_hex_value(data[i]) >= 0; i++)
+        {
+            value = value * 16 + (unsigned int)get_hex_value(data[i]);
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (value > 0xFF)
+    {
+        return 0;
+    }
+
+    decoded[0] = (char)value;
+
+    return i;
+}
+
+// Unescapes data into output, which may be data itself since the output
+// is never longer than the input. Returns false at the first invalid
+// escape, and only checks the escapes when output is NULL.
+static bool unescape_str(const char *data, size_t size, char *output, size_t *output_size, escape_style_t style)
+{
+    size_t start = 0;
+    size_t write_index = 0;
+
+    while (start < size)
+    {
+        const char *found = memchr(&data[start], '\\', size - start);
+        size_t i = (found != NULL) ? (size_t)(found - data) : size;
+
+        if (output != NULL)
+        {
+            memmove(&output[write_index], &data[start], i - start);
+        }
+
+        write_index += i - start;
+
+        if (i == size)
+        {
+            break;
+        }
+
+        char decoded[4];
+        size_t decoded_size = 0;
+        size_t escape_size = (style == ESCAPE_JSON) ? decode_json_escape(&data[i], size - i, decoded, &decoded_size)
+                                                    : decode_c_escape(&data[i], size - i, decoded, &decoded_size);
+
+        if (escape_size == 0)
+        {
+            return false;
+        }
+
+        if (output != NULL)
+        {
+            memcpy(&output[write_index], decoded, decoded_size);
+        }
+
+        write_index += decoded_size;
+        start = i + escape_size;
+    }
+
+    *output_size = write_index;
+
+    return true;
+}
+
+static bool unescape_dstr(dstr_t *dstr, escape_style_t style)
+{
+    size_t size = 0;
+
+    if (!unescape_str(dstr->data, dstr->size, NULL, &size, style))
+    {
+        return false;
+    }
+
+    invalidate_cached(dstr);
+    unescape_str(dstr->data, dstr->size, dstr->data, &size, style);
+    dstr->data[size] = '\0';
+    set_dstr_size(dstr, size);
+
+    return true;
+}
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char base64_url_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// The standard alphabet is padded with '=', the URL one isn't.
+static size_t get_base64_size(size_t size, bool is_url)
+{
+    if (is_url)
+    {
+        return size / 3 * 4 + ((size % 3 == 0) ? 0 : size % 3 + 1);
+    }
+
+    return (size + 2) / 3 * 4;
+}
+
+#if defined(__SSE2__)
+// Maps 6-bit indices to base64 chars. Every index starts at 'A' and each
+// range past the first adds the distance to where its chars start.
+static __m128i get_base64_chars(__m128i indices, bool is_url)
+{
+    __m128i chars = _mm_add_epi8(indices, _mm_set1_epi8('A'));
+
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(25)), _mm_set1_epi8('a' - 'A' - 26)));
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(51)), _mm_set1_epi8('0' - 'a' - 26)));
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(61)), _mm_set1_epi8((char)((is_url ? '-' : '+') - '0' - 10))));
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(indices, _mm_set1_epi8(62)), _mm_set1_epi8((char)((is_url ? '_' : '/') - (is_url ? '-' : '+') - 1))));
+
+    return chars;
+}
+#endif
+
+static void encode_base64(const char *data, size_t size, char *output, bool is_url)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    const char *alphabet = is_url ? base64_url_alphabet : base64_alphabet;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // 12 bytes make 16 chars. Each 32-bit lane gets the 24 bits of one
+    // group of 3 bytes, which are split into four 6-bit indices, one per byte.
+    while (i + 12 <= size)
+    {
+        const unsigned char *group = &bytes[i];
+        __m128i words = _mm_setr_epi32((int)((uint32_t)group[0] << 16 | (uint32_t)group[1] << 8 | group[2]),
+                                       (int)((uint32_t)group[3] << 16 | (uint32_t)group[4] << 8 | group[5]),
+                                       (int)((uint32_t)group[6] << 16 | (uint32_t)group[7] << 8 | group[8]),
+                                       (int)((uint32_t)group[9] << 16 | (uint32_t)group[10] << 8 | group[11]));
+        __m128i mask = _mm_set1_epi32(0x3F);
+        __m128i indices = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(words, 18), mask),
+                                                    _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(words, 12), mask), 8)),
+                                       _mm_or_si128(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(words, 6), mask), 16),
+                                                    _mm_slli_epi32(_mm_and_si128(words, mask), 24)));
+
+        _mm_storeu_si128((__m128i*)output, get_base64_chars(indices, is_url));
+        output += 16;
+        i += 12;
+    }
+#endif
+
+    for (; i + 3 <= size; i += 3)
+    {
+        uint32_t group = (uint32_t)bytes[i] << 16 | (uint32_t)bytes[i + 1] << 8 | bytes[i + 2];
+
+        *output++ = alphabet[group >> 18];
+        *output++ = alphabet[(group >> 12) & 0x3F];
+        *output++ = alphabet[(group >> 6) & 0x3F];
+        *output++ = alphabet[group & 0x3F];
+    }
+
+    if (i < size)
+    {
+        uint32_t group = (uint32_t)bytes[i] << 16 | ((i + 1 < size) ? (uint32_t)bytes[i + 1] << 8 : 0);
+
+        *output++ = alphabet[group >> 18];
+        *output++ = alphabet[(group >> 12) & 0x3F];
+
+        if (i + 1 < size)
+        {
+            *output++ = alphabet[(group >> 6) & 0x3F];
+        }
+        else if (!is_url)
+        {
+            *output++ = '=';
+        }
+
+        if (!is_url)
+        {
+            *output++ = '=';
+        }
+    }
+}
+
+static int get_base64_value(unsigned char letter, bool is_url)
+{
+    if (letter >= 'A' && letter <= 'Z')
+    {
+        return letter - 'A';
+    }
+    else if (letter >= 'a' && letter <= 'z')
+    {
+        return letter - 'a' + 26;
+    }
+    else if (letter >= '0' && letter <= '9')
+    {
+        return letter - '0' + 52;
+    }
+    else if (letter == (is_url ? '-' : '+'))
+    {
+        return 62;
+    }
+    else if (letter == (is_url ? '_' : '/'))
+    {
+        return 63;
+    }
+
+    return -1;
+}
+
+// Checks the length and padding, and returns the decoded size, or
+// SIZE_MAX if the input can't be valid. Padding is only allowed, and
+// then required, in the standard alphabet.
+static size_t get_decoded_base64_size(const char *data, size_t *size, bool is_url)
+{
+    size_t num_of_pads = 0;
+
+    if (!is_url)
+    {
+        if (*size % 4 != 0)
+        {
+            return SIZE_MAX;
+        }
+
+        while (num_of_pads < 2 && num_of_pads < *size && data[*size - num_of_pads - 1] == '=')
+        {
+            num_of_pads++;
+        }
+
+        *size -= num_of_pads;
+    }
+
+    if (*size % 4 == 1)
+    {
+        return SIZE_MAX;
+    }
+
+    return *size / 4 * 3 + ((*size % 4 == 0) ? 0 : *size % 4 - 1);
+}
+
+#if defined(__SSE2__)
+// Turns 16 chars into 16 6-bit values, and returns false if any
+// of them isn't in the alphabet.
+static bool get_base64_values(__m128i chars, bool is_url, __m128i *values)
+{
+    __m128i uppers = get_range_bytes(chars, 'A', 'Z');
+    __m128i lowers = get_range_bytes(chars, 'a', 'z');
+    __m128i digits = get_range_bytes(chars, '0', '9');
+    __m128i is_62 = _mm_cmpeq_epi8(chars, _mm_set1_epi8(is_url ? '-' : '+'));
+    __m128i is_63 = _mm_cmpeq_epi8(chars, _mm_set1_epi8(is_url ? '_' : '/'));
+    __m128i is_valid = _mm_or_si128(_mm_or_si128(uppers, lowers), _mm_or_si128(digits, _mm_or_si128(is_62, is_63)));
+
+    if (_mm_movemask_epi8(is_valid) != 0xFFFF)
+    {
+        return false;
+    }
+
+    __m128i shift = _mm_and_si128(uppers, _mm_set1_epi8(-'A'));
+    shift = _mm_or_si128(shift, _mm_and_si128(lowers, _mm_set1_epi8(26 - 'a')));
+    shift = _mm_or_si128(shift, _mm_and_si128(digits, _mm_set1_epi8(52 - '0')));
+    shift = _mm_or_si128(shift, _mm_and_si128(is_62, _mm_set1_epi8((char)(62 - (is_url ? '-' : '+')))));
+    shift = _mm_or_si128(shift, _mm_and_si128(is_63, _mm_set1_epi8((char)(63 - (is_url ? '_' : '/')))));
+    *values = _mm_add_epi8(chars, shift);
+
+    return true;
+}
+#endif
+
+// size is without padding. The last char must not have bits set that
+// don't end up in a byte, so every input has one valid encoding.
+static bool decode_base64(const char *data, size_t size, char *output, bool is_url)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Each block writes its 12 bytes as four 4-byte stores, so it stops
+    // while there is a full quad left to write over the 13th byte.
+    while (i + 20 <= size)
+    {
+        __m128i values;
+
+        if (!get_base64_values(_mm_loadu_si128((const __m128i*)&data[i]), is_url, &values))
+        {
+            return false;
+        }
+
+        __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0xFF)), 6), _mm_srli_epi16(values, 8));
+        __m128i words = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pairs, _mm_set1_epi32(0xFFFF)), 12), _mm_srli_epi32(pairs, 16));
+        uint32_t groups[4];
+
+        _mm_storeu_si128((__m128i*)groups, words);
+
+        for (size_t j = 0; j < 4; j++)
+        {
+            uint32_t group = __builtin_bswap32(groups[j] << 8);
+            memcpy(&output[j * 3], &group, sizeof(uint32_t));
+        }
+
+        output += 12;
+        i += 16;
+    }
+#endif
+
+    for (; i < size; i += 4)
+    {
+        size_t quad_size = (size - i < 4) ? size - i : 4;
+        uint32_t group = 0;
+
+        for (size_t j = 0; j < 4; j++)
+        {
+            int value = (j < quad_size) ? get_base64_value((unsigned char)data[i + j], is_url) : 0;
+
+            if (value < 0)
+            {
+                return false;
+            }
+
+            group = group << 6 | (uint32_t)value;
+        }
+
+        if ((quad_size == 2 && (group & 0xFFFF) != 0) || (quad_size == 3 && (group & 0xFF) != 0))
+        {
+            return false;
+        }
+
+        for (size_t j = 0; j + 1 < quad_size; j++)
+        {
+            *output++ = (char)(group >> (16 - j * 8));
+        }
+    }
+
+    return true;
+}
+
+static void encode_hex(const char *data, size_t size, char *output)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    __m128i low_mask = _mm_set1_epi8(0x0F);
+
+    while (i + 16 <= size)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)&data[i]);
+        __m128i highs = _mm_and_si128(_mm_srli_epi16(block, 4), low_mask);
+        __m128i lows = _mm_and_si128(block, low_mask);
+        __m128i letter_offset = _mm_set1_epi8('a' - '0' - 10);
+
+        highs = _mm_add_epi8(_mm_add_epi8(highs, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(highs, _mm_set1_epi8(9)), letter_offset));
+        lows = _mm_add_epi8(_mm_add_epi8(lows, _mm_set1_epi8('0')), _mm_and_si128(_mm_cmpgt_epi8(lows, _mm_set1_epi8(9)), letter_offset));
+
+        _mm_storeu_si128((__m128i*)&output[i * 2], _mm_unpacklo_epi8(highs, lows));
+        _mm_storeu_si128((__m128i*)&output[i * 2 + 16], _mm_unpackhi_epi8(highs, lows));
+        i += 16;
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        output[i * 2] = hex_digits[(unsigned char)data[i] >> 4];
+        output[i * 2 + 1] = hex_digits[(unsigned char)data[i] & 0xF];
+    }
+}
+
+// size must be even, upper and lower case digits are both fine.
+static bool decode_hex(const char *data, size_t size, char *output)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    while (i + 32 <= size)
+    {
+        __m128i values[2];
+
+        for (size_t j = 0; j < 2; j++)
+        {
+            __m128i chars = _mm_loadu_si128((const __m128i*)&data[i + j * 16]);
+            __m128i digits = get_range_bytes(chars, '0', '9');
+            __m128i letters = get_range_bytes(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'f');
+
+            if (_mm_movemask_epi8(_mm_or_si128(digits, letters)) != 0xFFFF)
+            {
+                return false;
+            }
+
+            values[j] = _mm_add_epi8(chars, _mm_or_si128(_mm_and_si128(digits, _mm_set1_epi8(-'0')),
+                                                         _mm_and_si128(letters, _mm_set1_epi8(10 - 'A'))));
+            // Lower case letters are 0x20 past upper case ones.
+            values[j] = _mm_and_si128(values[j], _mm_set1_epi8(0x1F));
+            values[j] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values[j], _mm_set1_epi16(0xFF)), 4), _mm_srli_epi16(values[j], 8));
+        }
+
+        _mm_storeu_si128((__m128i*)&output[i / 2], _mm_packus_epi16(values[0], values[1]));
+        i += 32;
+    }
+#endif
+
+    for (; i < size; i += 2)
+    {
+        int high = get_hex_value(data[i]);
+        int low = get_hex_value(data[i + 1]);
+
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+
+        output[i / 2] = (char)(high << 4 | low);
+    }
+
+    return true;
+}
+
+// Bit i of the result is the xor of bits 0 to i, so a bit is set
+// for every byte between an opening and a closing quote.
+static uint64_t prefix_xor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+
+    return bits;
+}
+
+static void get_csv_masks(const char *block, char delimiter, uint64_t *quotes, uint64_t *ends)
+{
+    *quotes = 0;
+    *ends = 0;
+
+#if defined(__SSE2__)
+    for (size_t i = 0; i < CSV_BLOCK_SIZE; i += 16)
+    {
+        __m128i chars = _mm_loadu_si128((const __m128i*)&block[i]);
+        uint64_t quote_bits = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')));
+        uint64_t end_bits = (uint16_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(delimiter)),
+                                                                     _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n'))));
+
+        *quotes |= quote_bits << i;
+        *ends |= end_bits << i;
+    }
+#else
+    for (size_t i = 0; i < CSV_BLOCK_SIZE; i++)
+    {
+        *quotes |= (uint64_t)(block[i] == '"') << i;
+        *ends |= (uint64_t)(block[i] == delimiter || block[i] == '\n') << i;
+    }
+#endif
+}
+
+static void add_csv_field(dstr_csv_reader_t *reader, size_t start, size_t end)
+{
+    if (reader->num_of_fields == reader->fields_capacity)
+    {
+        size_t capacity = reader->fields_capacity * 2;
+
+        reader->raw_fields = mem_realloc(reader->raw_fields, sizeof(csv_field_t) * reader->fields_capacity, sizeof(csv_field_t) * capacity);
+        reader->fields = mem_realloc(reader->fields, sizeof(dstr_view_t) * reader->fields_capacity, sizeof(dstr_view_t) * capacity);
+        reader->fields_capacity = capacity;
+    }
+
+    reader->raw_fields[reader->num_of_fields++] = (csv_field_t){start, end};
+}
+
+// Classifies the block at next_block_start. Only the last, partial block
+// is copied and padded. The delimiter can't be '\0', so padding never ends
+// a field.
+static void read_csv_block(dstr_csv_reader_t *reader)
+{
+    size_t start = reader->next_block_start;
+    const char *block = &reader->data[start];
+    char padded_block[CSV_BLOCK_SIZE];
+    uint64_t quotes;
+    uint64_t ends;
+
+    if (reader->size - start < CSV_BLOCK_SIZE)
+    {
+        memset(padded_block, 0, CSV_BLOCK_SIZE);
+        memcpy(padded_block, block, reader->size - start);
+        block = padded_block;
+    }
+
+    get_csv_masks(block, reader->delimiter, &quotes, &ends);
+
+    uint64_t inside = prefix_xor(quotes) ^ reader->in_quote;
+
+    reader->in_quote = (inside >> 63) ? UINT64_MAX : 0;
+    reader->block_ends = ends & ~inside;
+    reader->block_start = start;
+    reader->next_block_start = start + CSV_BLOCK_SIZE;
+}
+
+// The first stage. Escaped quotes toggle the quote state twice, so they
+// need no special case. Returns false if the data ran out in the middle
+// of a record and more of the stream can still be read.
+static bool find_csv_record(dstr_csv_reader_t *reader)
+{
+    const char *data = reader->data;
+    size_t size = reader->size;
+    size_t field_start = reader->position;
+
+    reader->num_of_fields = 0;
+
+    while (true)
+    {
+        // Kept in locals, add_csv_field writing to the reader would
+        // otherwise make them be reloaded for every field.
+        uint64_t ends = reader->block_ends;
+        size_t block_start = reader->block_start;
+
+        while (ends != 0)
+        {
+            size_t end = block_start + (size_t)__builtin_ctzll(ends);
+
+            ends &= ends - 1;
+            add_csv_field(reader, field_start, end);
+            field_start = end + 1;
+
+            if (data[end] == '\n')
+            {
+                reader->block_ends = ends;
+                reader->position = end + 1;
+                return true;
+            }
+        }
+
+        reader->block_ends = 0;
+
+        if (reader->next_block_start >= size)
+        {
+            break;
+        }
+
+        read_csv_block(reader);
+    }
+
+    if (!reader->is_eof)
+    {
+        return false;
+    }
+
+    add_csv_field(reader, field_start, size);
+    reader->position = size;
+
+    return true;
+}
+
+// The second stage. A field in quotes loses them, and if it has escaped
+// quotes it is copied into scratch without the extra ones. scratch is
+// reserved for the whole record first, so its views don't move.
+static void setup_csv_fields(dstr_csv_reader_t *reader)
+{
+    const char *data = reader->data;
+    size_t record_size = reader->raw_fields[reader->num_of_fields - 1].end - reader->raw_fields[0].start;
+    dstr_t *scratch = reader->scratch;
+    size_t scratch_size = 0;
+
+    // Only the capacity of scratch is used, its size stays 0 so nothing
+    // needs updating per record.
+    reserve_dstr_data(scratch, record_size);
+
+    for (size_t i = 0; i < reader->num_of_fields; i++)
+    {
+        size_t start = reader->raw_fields[i].start;
+        size_t end = reader->raw_fields[i].end;
+
+        if (i == reader->num_of_fields - 1 && end > start && data[end - 1] == '\r')
+        {
+            end--;
+        }
+
+        if (end - start < 2 || data[start] != '"' || data[end - 1] != '"')
+        {
+            reader->fields[i] = (dstr_view_t){&data[start], end - start};
+            continue;
+        }
+
+        start++;
+        end--;
+
+        if (memchr(&data[start], '"', end - start) == NULL)
+        {
+            reader->fields[i] = (dstr_view_t){&data[start], end - start};
+            continue;
+        }
+
+        char *field = &scratch->data[scratch_size];
+        size_t size = 0;
+
+        for (size_t j = start; j < end; j++)
+        {
+            field[size++] = data[j];
+            j += (data[j] == '"' && j + 1 < end && data[j + 1] == '"');
+        }
+
+        reader->fields[i] = (dstr_view_t){field, size};
+        scratch_size += size;
+    }
+}
+
+// Keeps the unfinished record, moved to the front of the buffer, and reads
+// more after it. The buffer doubles when the record alone fills it. The
+// last block was padded, so the record is classified again from its start,
+// which is outside of quotes.
+static void refill_csv_reader(dstr_csv_reader_t *reader)
+{
+    dstr_t *buffer = reader->buffer;
+    size_t kept_size = reader->size - reader->position;
+
+    memmove(buffer->data, &buffer->data[reader->position], kept_size);
+    reserve_dstr_data(buffer, kept_size + CSV_BUFFER_SIZE / 2);
+
+    size_t num_of_read = fread(&buffer->data[kept_size], sizeof(char), buffer->capacity - kept_size, reader->fp);
+
+    reader->is_eof = (num_of_read == 0);
+    set_dstr_size(buffer, kept_size + num_of_read);
+    reader->data = buffer->data;
+    reader->size = buffer->size;
+    reader->position = 0;
+    reader->next_block_start = 0;
+    reader->block_ends = 0;
+    reader->in_quote = 0;
+}
+
+static dstr_csv_reader_t *alloc_csv_reader(char delimiter, const char *func_name)
+{
+    if (delimiter == '"' || delimiter == '\n' || delimiter == '\r' || delimiter == '\0')
+    {
+        printf("%s: %swarning:%s delimiter can't be a quote, newline or '\\0'%s\n", func_name, PURPLE, WHITE, RESET);
+        return NULL;
+    }
+
+    dstr_csv_reader_t *reader = mem_alloc(sizeof(dstr_csv_reader_t));
+
+    reader->delimiter = delimiter;
+    reader->fp = NULL;
+    reader->is_eof = true;
+    reader->data = NULL;
+    reader->size = 0;
+    reader->position = 0;
+    reader->block_start = 0;
+    reader->next_block_start = 0;
+    reader->block_ends = 0;
+    reader->in_quote = 0;
+    reader->buffer = NULL;
+    reader->scratch = alloc_dstr();
+    set_empty_dstr(reader->scratch);
+    reader->num_of_fields = 0;
+    reader->fields_capacity = DEFAULT_CAPACITY;
+    reader->raw_fields = mem_alloc(sizeof(csv_field_t) * DEFAULT_CAPACITY);
+    reader->fields = mem_alloc(sizeof(dstr_view_t) * DEFAULT_CAPACITY);
+
+    return reader;
+}
+
+static void setup_split_set(split_set_t *set, const char *charset)
+{
+    memset(set->is_member, 0, sizeof(set->is_member));
+    set->is_whitespace = (charset == NULL);
+    set->num_of_bytes = 0;
+
+    if (set->is_whitespace)
+    {
+        for (unsigned char letter = '\t'; letter <= '\r'; letter++)
+        {
+            set->is_member[letter] = true;
+        }
+
+        set->is_member[' '] = true;
+        return;
+    }
+
+    for (const unsigned char *letter = (const unsigned char*)charset; *letter != '\0'; letter++)
+    {
+        if (set->is_member[*letter])
+        {
+            continue;
+        }
+
+        if (set->num_of_bytes < SPLIT_MAX_SIMD_BYTES)
+        {
+            set->bytes[set->num_of_bytes] = *letter;
+        }
+
+        set->is_member[*letter] = true;
+        set->num_of_bytes++;
+    }
+}
+
+#if defined(__SSE2__)
+static bool is_simd_split_set(const split_set_t *set)
+{
+    return set->is_whitespace || set->num_of_bytes <= SPLIT_MAX_SIMD_BYTES;
+}
+
+// Returns a bit for every byte of the block whose membership in the set
+// is is_member.
+static int get_split_set_mask(const split_set_t *set, __m128i block, bool is_member)
+{
+    __m128i is_in_set;
+
+    if (set->is_whitespace)
+    {
+        is_in_set = _mm_or_si128(get_range_bytes(block, '\t', '\r'), _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+    }
+    else
+    {
+        is_in_set = _mm_setzero_si128();
+
+        for (size_t i = 0; i < set->num_of_bytes; i++)
+        {
+            is_in_set = _mm_or_si128(is_in_set, _mm_cmpeq_epi8(block, _mm_set1_epi8((char)set->bytes[i])));
+        }
+    }
+
+    int mask = _mm_movemask_epi8(is_in_set);
+
+    return is_member ? mask : mask ^ 0xFFFF;
+}
+#endif
+
+// Returns the index of the first byte in [start, end) whose membership in
+// the set is is_member, or end.
+static size_t find_split_byte(const split_set_t *set, const char *data, size_t start, size_t end, bool is_member)
+{
+    size_t i = start;
+
+#if defined(__SSE2__)
+    if (is_simd_split_set(set))
+    {
+        while (i + 16 <= end)
+        {
+            int mask = get_split_set_mask(set, _mm_loadu_si128((const __m128i*)&data[i]), is_member);
+
+            if (mask != 0)
+            {
+                return i + (size_t)__builtin_ctz((unsigned int)mask);
+            }
+
+            i += 16;
+        }
+    }
+#endif
+
+    while (i < end && set->is_member[(unsigned char)data[i]] != is_member)
+    {
+        i++;
+    }
+
+    return i;
+}
+
+// The same from the back. Returns the index after the last such byte in
+// [start, end), or start.
+static size_t rfind_split_byte(const split_set_t *set, const char *data, size_t start, size_t end, bool is_member)
+{
+    size_t i = end;
+
+#if defined(__SSE2__)
+    if (is_simd_split_set(set))
+    {
+        while (i >= start + 16)
+        {
+            int mask = get_split_set_mask(set, _mm_loadu_si128((const __m128i*)&data[i - 16]), is_member);
+
+            if (mask != 0)
+            {
+                return i - 16 + (size_t)(32 - __builtin_clz((unsigned int)mask));
+            }
+
+            i -= 16;
+        }
+    }
+#endif
+
+    while (i > start && set->is_member[(unsigned char)data[i - 1]] != is_member)
+    {
+        i--;
+    }
+
+    return i;
+}
+
+static void setup_split_builder(split_builder_t *builder)
+{
+    builder->capacity = DEFAULT_CAPACITY;
+    builder->dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    builder->dstr_array->size = 0;
+    builder->dstr_array->data_set = mem_alloc(builder->capacity * sizeof(dstr_t*));
+}
+
+static void add_split_field(split_builder_t *builder, const char *data, size_t size)
+{
+    dstr_arr_t *dstr_array = builder->dstr_array;
+
+    if (dstr_array->size == builder->capacity)
+    {
+        dstr_array->data_set = mem_realloc(dstr_array->data_set, builder->capacity * sizeof(dstr_t*), builder->capacity * 2 * sizeof(dstr_t*));
+        builder->capacity *= 2;
+    }
+
+    dstr_array->data_set[dstr_array->size++] = alloc_sized_dstr(data, size);
+}
+
+// Fields found from the back are added last first, is_reversed puts them
+// back in order.
+static dstr_arr_t *get_split_arr(split_builder_t *builder, bool is_reversed)
+{
+    dstr_arr_t *dstr_array = builder->dstr_array;
+
+    for (size_t i = 0; is_reversed && i < dstr_array->size / 2; i++)
+    {
+        dstr_t *temp = dstr_array->data_set[i];
+        dstr_array->data_set[i] = dstr_array->data_set[dstr_array->size - 1 - i];
+        dstr_array->data_set[dstr_array->size - 1 - i] = temp;
+    }
+
+    // Nothing was found, so the array is left without a data_set
+    // instead of shrinking it to zero bytes.
+    if (dstr_array->size == 0)
+    {
+        mem_free(dstr_array->data_set, builder->capacity * sizeof(dstr_t*));
+        dstr_array->data_set = NULL;
+    }
+    else if (dstr_array->size < builder->capacity)
+    {
+        dstr_array->data_set = mem_realloc(dstr_array->data_set, builder->capacity * sizeof(dstr_t*), dstr_array->size * sizeof(dstr_t*));
+    }
+
+    return dstr_array;
+}
+
+// Runs of whitespace are one separator and there are no empty fields, like
+// Python's split(). Once max_split fields are found the rest is the last
+// field, with only the leading whitespace dropped.
+static dstr_arr_t *split_whitespace(const char *data, size_t size, size_t max_split)
+{
+    split_set_t set;
+    split_builder_t builder;
+
+    setup_split_set(&set, NULL);
+    setup_split_builder(&builder);
+
+    size_t start = find_split_byte(&set, data, 0, size, false);
+
+    while (start < size)
+    {
+        if (max_split != 0 && builder.dstr_array->size == max_split)
+        {
+            add_split_field(&builder, &data[start], size - start);
+            break;
+        }
+
+        size_t end = find_split_byte(&set, data, start, size, true);
+
+        add_split_field(&builder, &data[start], end - start);
+        start = find_split_byte(&set, data, end, size, false);
+    }
+
+    return get_split_arr(&builder, false);
+}
+
+static dstr_arr_t *rsplit_whitespace(const char *data, size_t size, size_t max_split)
+{
+    split_set_t set;
+    split_builder_t builder;
+
+    setup_split_set(&set, NULL);
+    setup_split_builder(&builder);
+
+    size_t end = rfind_split_byte(&set, data, 0, size, false);
+
+    while (end > 0)
+    {
+        if (max_split != 0 && builder.dstr_array->size == max_split)
+        {
+            add_split_field(&builder, data, end);
+            break;
+        }
+
+        size_t start = rfind_split_byte(&set, data, 0, end, true);
+
+        add_split_field(&builder, &data[start], end - start);
+        end = rfind_split_byte(&set, data, 0, start, false);
+    }
+
+    return get_split_arr(&builder, true);
+}
+
+// Every byte of the charset is a separator on its own, so empty fields are
+// kept, the same as dstr_alloc_splitdstr.
+static dstr_arr_t *split_any(const char *data, size_t size, const char *charset, size_t max_split)
+{
+    split_set_t set;
+    split_builder_t builder;
+
+    setup_split_set(&set, charset);
+    setup_split_builder(&builder);
+
+    for (size_t start = 0; ; )
+    {
+        bool is_last = (max_split != 0 && builder.dstr_array->size == max_split);
+        size_t end = is_last ? size : find_split_byte(&set, data, start, size, true);
+
+        add_split_field(&builder, &data[start], end - start);
+
+        if (end == size)
+        {
+            break;
+        }
+
+        start = end + 1;
+    }
+
+    return get_split_arr(&builder, false);
+}
+
+static dstr_arr_t *rsplit_any(const char *data, size_t size, const char *charset, size_t max_split)
+{
+    split_set_t set;
+    split_builder_t builder;
+
+    setup_split_set(&set, charset);
+    setup_split_builder(&builder);
+
+    for (size_t end = size; ; )
+    {
+        bool is_last = (max_split != 0 && builder.dstr_array->size == max_split);
+        size_t start = is_last ? 0 : rfind_split_byte(&set, data, 0, end, true);
+
+        add_split_field(&builder, &data[start], end - start);
+
+        if (start == 0)
+        {
+            break;
+        }
+
+        end = start - 1;
+    }
+
+    return get_split_arr(&builder, true);
+}
+
+size_t str_ascii_total(const char *data)
+{
+    if (is_not_valid_str(data, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(0);
+
+    return sum_bytes(data, strlen(data));
+}
+
+dstr_metrics_t dstr_metrics_snapshot(void)
+{
+    dstr_metrics_t metrics = {0};
+
+    // The retired totals are read under the lock too, so a thread that
+    // exits meanwhile is counted once, in one or the other.
+    pthread_mutex_lock(&metrics_lock);
+
+    int64_t num_of_allocs = atomic_load_explicit(&retired_metrics.num_of_allocs, memory_order_relaxed);
+    int64_t bytes = atomic_load_explicit(&retired_metrics.bytes, memory_order_relaxed);
+    int64_t num_of_dstrs = atomic_load_explicit(&retired_metrics.num_of_dstrs, memory_order_relaxed);
+    int64_t capacity_bytes = atomic_load_explicit(&retired_metrics.dstr_capacity_bytes, memory_order_relaxed);
+    int64_t size_bytes = atomic_load_explicit(&retired_metrics.dstr_size_bytes, memory_order_relaxed);
+
+    for (metrics_shard_t *shard = metrics_shards; shard != NULL; shard = shard->next)
+    {
+        num_of_allocs += atomic_load_explicit(&shard->num_of_allocs, memory_order_relaxed);
+        bytes += atomic_load_explicit(&shard->bytes, memory_order_relaxed);
+        num_of_dstrs += atomic_load_explicit(&shard->num_of_dstrs, memory_order_relaxed);
+        capacity_bytes += atomic_load_explicit(&shard->dstr_capacity_bytes, memory_order_relaxed);
+        size_bytes += atomic_load_explicit(&shard->dstr_size_bytes, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&metrics_lock);
+
+    // The shards are read one by one while the other threads keep going,
+    // so a snapshot taken mid-flight can be slightly off, but never negative.
+    update_peak_bytes(bytes);
+
+    metrics.num_of_allocs = (num_of_allocs > 0) ? (size_t)num_of_allocs : 0;
+    metrics.current_bytes = (bytes > 0) ? (size_t)bytes : 0;
+    metrics.peak_bytes = (size_t)atomic_load_explicit(&peak_bytes, memory_order_relaxed);
+    metrics.num_of_dstrs = (num_of_dstrs > 0) ? (size_t)num_of_dstrs : 0;
+    metrics.capacity_slack = (capacity_bytes > size_bytes) ? (size_t)(capacity_bytes - size_bytes) : 0;
+
+    return metrics;
+}
+
+size_t dstr_get_num_of_allocs(void)
+{
+    return dstr_metrics_snapshot().num_of_allocs;
+}
+
+/*
+void dstr_set_size(dstr_t *dstr, int64_t size)
+{
+    if (check_warnings(str, STR_NULL, __func__))
+    {
+        return;
+    }
+    else if (size < 0)
+    {
+        printf("%s: %swarning:%s size is less than 0%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
+
+    str->size = size;
+}
+
+void dstr_set_capacity(dstr_t *dstr, int64_t capacity)
+{
+    if (check_warnings(str, STR_NULL, __func__))
+    {
+        return;
+    }
+    else if (capacity < 0)
+    {
+        printf("%s: %swarning:%s capacity is less than 0%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
+
+    str->capacity = capacity;
+}
+
+void dstr_set_literal(dstr_t *dstr, char *data)
+{
+    if (check_warnings(str, STR_NULL, __func__))
+    {
+        return;
+    }
+    else if (is_not_valid_str(data, __func__))
+    {
+        return;
+    }
+
+    str->data = data;
+}
+*/
+
+size_t dstr_get_size(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    return dstr->size;
+}
+
+size_t dstr_get_capacity(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    return dstr->capacity;
+}
+
+char *dstr_get_literal(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return NULL;
+    }
+
+    return dstr->data;
+}
+
+dstr_t *dstr_alloc(const char *data)
+{
+    if (is_str_null(data, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_t *dstr = alloc_dstr();
+    alloc_dstr_capacity(dstr, strlen(data));
+
+    memcpy(dstr->data, data, dstr->size + 1);
+
+    return dstr;
+}
+
+dstr_t *dstr_alloc_va(size_t size, ...)
+{
+    if (is_size_zero(size, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    va_list args;
+    va_start(args, size);
+
+    dstr_t *dstr = dstr_alloc(va_arg(args, char*));
+
+    for (size_t i = 1; i < size; i++)
+    {
+        dstr_append(dstr, va_arg(args, char*));
+    }
+
+    va_end(args);
+
+    return dstr;
+}
+
+void dstr_append(dstr_t *dstr, const char *data)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(data, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    invalidate_cached(dstr);
+
+    size_t data_size = dstr_realloc_capacity(dstr, data);
+
+    memcpy(&dstr->data[dstr->size - data_size], data, data_size + 1);
+}
+
+void dstr_append_va(dstr_t *dstr, size_t size, ...)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_size_zero(size, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    va_list args;
+    va_start(args, size);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        dstr_append(dstr, va_arg(args, char*));
+    }
+
+    va_end(args);
+}
+
+dstr_t *dstr_add(dstr_t *curr_dstr, dstr_t *newest_dstr)
+{
+    PROFILE_FUNC(0);
+
+    return dstr_add_va(2, curr_dstr, newest_dstr);
+}
+
+dstr_t *dstr_add_va(size_t size, ...)
+{
+    if (is_size_zero(size, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    va_list args;
+    va_start(args, size);
+
+    dstr_t *temp_dstr = NULL;
+    dstr_t *total_dstr = dstr_alloc_copy(va_arg(args, dstr_t*));
+
+    for (size_t i = 1; i < size; i++)
+    {
+        temp_dstr = va_arg(args, dstr_t*);
+
+        if (temp_dstr == NULL)
+        {
+            va_end(args);
+            return total_dstr;
+        }
+
+        dstr_append(total_dstr, temp_dstr->data);
+    }
+
+    va_end(args);
+
+    return total_dstr;
+}
+
+void dstr_add_equals(dstr_t *curr_dstr, dstr_t *newest_dstr)
+{
+    PROFILE_FUNC(0);
+
+    dstr_add_equals_va(curr_dstr, 1, newest_dstr);
+}
+
+void dstr_add_equals_va(dstr_t *dstr, size_t size, ...)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_size_zero(size, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    va_list args;
+    va_start(args, size);
+
+    dstr_t *temp_dstr = NULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        temp_dstr = va_arg(args, dstr_t*);
+
+        if (temp_dstr == NULL)
+        {
+            va_end(args);
+            return;
+        }
+
+        dstr_append(dstr, temp_dstr->data);
+    }
+
+    va_end(args);
+}
+
+void dstr_before(dstr_t *dstr, const char *data)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(data, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    invalidate_cached(dstr);
+
+    size_t data_size = dstr_realloc_capacity(dstr, data);
+
+    memmove(&dstr->data[data_size], dstr->data, (dstr->size - data_size) + 1);
+    memcpy(dstr->data, data, data_size);
+}
+
+dstr_t *dstr_alloc_substr(const char *data, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt)
+{
+    if (is_not_valid_str(data, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    return alloc_substr(data, strlen(data), start_opt, end_opt, step_opt, __func__);
+}
+
+dstr_t *dstr_alloc_subdstr(dstr_t *dstr, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return alloc_substr(dstr->data, dstr->size, start_opt, end_opt, step_opt, __func__);
+}
+
+bool dstr_is_substr(const char *big, const char *little)
+{
+    if (big == NULL || little == NULL)
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(0);
+
+    char *result = strstr(big, little);
+
+    if (!(result))
+    {
+        return false;
+    }
+
+    return !(strncmp(little, result, strlen(little)));
+}
+
+bool dstr_is_subdstr(dstr_t *big, dstr_t *little)
+{
+    PROFILE_FUNC(0);
+
+    return dstr_is_substr(big->data, little->data);
+}
+
+bool dstr_is_isubstr(const char *big, const char *little)
+{
+    if (big == NULL || little == NULL)
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(0);
+
+    size_t little_size = strlen(little);
+
+    return (little_size == 0 || find_nocase(big, strlen(big), little, little_size) != NULL);
+}
+
+bool dstr_is_isubdstr(dstr_t *big, dstr_t *little)
+{
+    if (big == NULL || little == NULL)
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(big->size);
+
+    return (little->size == 0 || find_nocase(big->data, big->size, little->data, little->size) != NULL);
+}
+
+void dstr_replace(dstr_t *dstr, const char *old_str, const char *new_str)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_str_null(old_str, __func__)
+        || is_str_null(new_str, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    dstr_replace_count(dstr, old_str, new_str, 0);
+}
+
+void dstr_replace_count(dstr_t *dstr, const char *old_str, const char *new_str, size_t count)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_str_null(old_str, __func__)
+        || is_str_null(new_str, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    if (!(replace_in_dstr(dstr, old_str, new_str, count)))
+    {
+        printf("%s: %swarning:%s could not find substring%s\n", __func__, PURPLE, WHITE, RESET);
+    }
+}
+
+void dstr_ireplace(dstr_t *dstr, const char *old_str, const char *new_str)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_str_null(old_str, __func__)
+        || is_str_null(new_str, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    dstr_ireplace_count(dstr, old_str, new_str, 0);
+}
+
+void dstr_ireplace_count(dstr_t *dstr, const char *old_str, const char *new_str, size_t count)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_str_null(old_str, __func__)
+        || is_str_null(new_str, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    size_t num_of_occurrences = count_occurrences_nocase(dstr->data, dstr->size, old_str, count);
+
+    if (num_of_occurrences == 0)
+    {
+        printf("%s: %swarning:%s could not find substring%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
+
+    invalidate_cached(dstr);
+
+    size_t i = 0;
+    size_t old_str_size = strlen(old_str);
+    size_t new_str_size = strlen(new_str);
+    size_t total_size = ((dstr->size - (old_str_size  * num_of_occurrences)) + (new_str_size * num_of_occurrences));
+
+    size_t capacity = calculate_capacity(total_size);
+
+    const char *copy = dstr->data;
+    const char *end = dstr->data + dstr->size;
+    char *replacement = alloc_dstr_data(capacity);
+
+    // Clean runs between matches are copied in bulk.
+    for (size_t num_of_replacements = 0; num_of_replacements < num_of_occurrences; num_of_replacements++)
+    {
+        const char *found = find_nocase(copy, (size_t)(end - copy), old_str, old_str_size);
+        size_t run_size = (size_t)(found - copy);
+
+        memcpy(&replacement[i], copy, run_size);
+        memcpy(&replacement[i + run_size], new_str, new_str_size);
+        i += run_size + new_str_size;
+        copy = found + old_str_size;
+    }
+
+    memcpy(&replacement[i], copy, (size_t)(end - copy));
+    replacement[total_size] = '\0';
+
+    dstr_data_free(dstr);
+    set_dstr_data(dstr, replacement, capacity);
+    set_dstr_size(dstr, total_size);
+}
+
+void dstr_erase(dstr_t *dstr, const char *data)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_str_null(data, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    dstr_replace_count(dstr, data, "", 0);
+}
+
+void dstr_erase_count(dstr_t *dstr, const char *data, int64_t count)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_str_null(data, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    dstr_replace_count(dstr, data, "", (count < 0) ? 0 : (size_t)count);
+}
+
+void dstr_erase_index(dstr_t *dstr, int64_t start, int64_t end)
+{
+    if (is_dstr_null(dstr, __func__)
+        || check_ranges(&start, &end, dstr->size, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    invalidate_cached(dstr);
+
+    size_t conjoin_data_size = dstr->size - (size_t)(end - start);
+    size_t capacity = calculate_capacity(conjoin_data_size);
+    char *conjoin_data = alloc_dstr_data(capacity);
+
+    memcpy(conjoin_data, dstr->data, start);
+    memcpy(&conjoin_data[start], &dstr->data[end], (conjoin_data_size - (size_t)start));
+    conjoin_data[conjoin_data_size] = '\0';
+
+    dstr_data_free(dstr);
+    set_dstr_data(dstr, conjoin_data, capacity);
+    set_dstr_size(dstr, conjoin_data_size);
+}
+
+size_t dstr_find(dstr_t *dstr, const char *search_val)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(search_val, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    size_t found = find_earliest_in_str(dstr->data, dstr->size, search_val);
+
+    if (found == SIZE_MAX)
+    {
+        printf("%s: %swarning:%s could not find the searched string%s\n", __func__, PURPLE, WHITE, RESET);
+        return 0;
+    }
+
+    return found;
+}
+
+int64_t dstr_find_from(dstr_t *dstr, const char *search_val, int64_t start)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(search_val, __func__))
+    {
+        return -1;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    int64_t size = (int64_t)dstr->size;
+
+    if (start < 0)
+    {
+        start = (start + size < 0) ? 0 : start + size;
+    }
+
+    if (start > size)
+    {
+        return -1;
+    }
+
+    const char *found = find_in_str(&dstr->data[start], (size_t)(size - start), search_val, strlen(search_val));
+
+    return (found == NULL) ? -1 : (int64_t)(found - dstr->data);
+}
+
+int64_t dstr_rfind(dstr_t *dstr, const char *search_val)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(search_val, __func__))
+    {
+        return -1;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    const char *found = rfind_in_str(dstr->data, dstr->size, search_val, strlen(search_val));
+
+    return (found == NULL) ? -1 : (int64_t)(found - dstr->data);
+}
+
+size_t dstr_find_all(dstr_t *dstr, const char *search_val, bool is_overlapping, dstr_index_arr_t *index_array)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(search_val, __func__)
+        || is_index_arr_null(index_array, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    size_t search_val_size = strlen(search_val);
+    size_t step = is_overlapping ? 1 : search_val_size;
+    const char *end = dstr->data + dstr->size;
+    const char *found = find_in_str(dstr->data, dstr->size, search_val, search_val_size);
+
+    index_array->size = 0;
+
+    while (found != NULL)
+    {
+        index_arr_push(index_array, (size_t)(found - dstr->data));
+        found += step;
+        found = find_in_str(found, (size_t)(end - found), search_val, search_val_size);
+    }
+
+    return index_array->size;
+}
+
+size_t dstr_count(dstr_t *dstr, const char *search_val, int64_t start, int64_t end)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(search_val, __func__) 
+        || check_ranges(&start, &end, dstr->size, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return count_in_str(&dstr->data[start], (size_t)(end - start), search_val);
+}
+
+size_t dstr_ifind(dstr_t *dstr, const char *search_val)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(search_val, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    const char *found = find_nocase(dstr->data, dstr->size, search_val, strlen(search_val));
+
+    if (found == NULL)
+    {
+        printf("%s: %swarning:%s could not find the searched string%s\n", __func__, PURPLE, WHITE, RESET);
+        return 0;
+    }
+
+    return (size_t)(found - dstr->data);
+}
+
+size_t dstr_icount(dstr_t *dstr, const char *search_val, int64_t start, int64_t end)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(search_val, __func__) 
+        || check_ranges(&start, &end, dstr->size, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return count_occurrences_nocase(&dstr->data[start], (size_t)(end - start), search_val, 0);
+}
+
+void dstr_lstrip(dstr_t *dstr, const char *characters)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(characters, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    char *copy = dstr->data;
+
+    while (*copy != '\0' && strchr(characters, *copy))
+    {
+        copy++;
+    }
+
+    if (copy == dstr->data)
+    {
+        return;
+    }
+
+    invalidate_cached(dstr);
+
+    if (*copy != '\0')
+    {
+        size_t striped_size = dstr->size - (size_t)(copy - dstr->data);
+        size_t capacity = calculate_capacity(striped_size);
+        char *striped = alloc_dstr_data(capacity);
+
+        memcpy(striped, copy, striped_size + 1);
+        dstr_data_free(dstr);
+
+        set_dstr_data(dstr, striped, capacity);
+        set_dstr_size(dstr, striped_size);
+    }
+    else
+    {
+        dstr_data_free(dstr);
+        set_empty_dstr(dstr);
+    }
+}
+
+void dstr_rstrip(dstr_t *dstr, const char *characters)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(characters, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    char *forward = dstr->data + dstr->size;
+
+    while (forward != dstr->data && strchr(characters, (*(forward-1))))
+    {
+        forward--;
+    }
+
+    if (forward == (dstr->data + dstr->size))
+    {
+        return;
+    }
+
+    invalidate_cached(dstr);
+
+    if (forward != dstr->data)
+    {
+        size_t striped_size = (size_t)(forward - dstr->data);
+        size_t capacity = calculate_capacity(striped_size);
+        char *striped = alloc_dstr_data(capacity);
+
+        memcpy(striped, dstr->data, striped_size);
+        dstr_data_free(dstr);
+        striped[striped_size] = '\0';
+
+        set_dstr_data(dstr, striped, capacity);
+        set_dstr_size(dstr, striped_size);
+    }
+    else
+    {
+        dstr_data_free(dstr);
+        set_empty_dstr(dstr);
+    }
+}
+
+void dstr_strip(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    dstr_lstrip(dstr, "\n ");
+    dstr_rstrip(dstr, "\n ");
+}
+
+void dstr_strip_chars(dstr_t *dstr, const char *characters)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(characters, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    dstr_lstrip(dstr, characters);
+    dstr_rstrip(dstr, characters);
+}
+
+char dstr_char_at(dstr_t *dstr, int64_t index)
+{
+    if (is_dstr_null(dstr, __func__)
+        ||check_index(&index, dstr->size, __func__))
+    {
+        return '\0';
+    }
+
+    PROFILE_FUNC(0);
+
+    return dstr->data[index];
+}
+
+void dstr_upper(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    invalidate_cached(dstr);
+
+    size_t i = 0;
+
+    while (dstr->data[i] != '\0')
+    {
+        dstr->data[i] = ascii_upper(dstr->data[i]);
+        i++;
+    }
+}
+
+void dstr_lower(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    invalidate_cached(dstr);
+
+    size_t i = 0;
+
+    while (dstr->data[i] != '\0')
+    {
+        dstr->data[i] = ascii_lower(dstr->data[i]);
+        i++;
+    }
+}
+
+void dstr_swapcase(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    invalidate_cached(dstr);
+
+    size_t i = 0;
+
+    while (dstr->data[i] != '\0')
+    {
+        dstr->data[i] = (dstr->data[i] >= 'A' && dstr->data[i] <= 'Z') ? ascii_lower(dstr->data[i]) : ascii_upper(dstr->data[i]);
+        i++;
+    }
+}
+
+void dstr_capitalize(dstr_t *dstr)
+{  
+    if (is_dstr_null(dstr, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    invalidate_cached(dstr);
+
+    dstr->data[0] = ascii_upper(dstr->data[0]);
+}
+
+void dstr_title(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    dstr_capitalize(dstr);
+
+    for (size_t i = (dstr->size-1); i > 0; i--)
+    {
+        if (!(is_word_byte(dstr->data[i-1])))
+        {
+            dstr->data[i] = ascii_upper(dstr->data[i]);
+        }
+    }
+}
+
+dstr_t *dstr_alloc_prompt(const char *output_message)
+{
+    if (is_str_null(output_message, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_t *dstr = alloc_dstr();
+
+    set_empty_dstr(dstr);
+    fputs(output_message, stdout);
+    fflush(stdout);
+    read_stream_line(dstr, stdin);
+
+    return dstr;
+}
+
+dstr_t *dstr_alloc_read_file(const char *path, const char *mode)
+{
+    if (is_not_valid_str(path, __func__)
+        || is_not_valid_str(mode, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    if (strstr(mode, "w") != NULL || strstr(mode, "a") != NULL)
+    {
+        printf("%s: %swarning:%s file can not be written%s\n", __func__, PURPLE, WHITE, RESET);
+        return NULL;
+    }
+
+    FILE *fp = fopen(path, mode);
+    dstr_t *dstr = NULL;
+
+    if (strstr(mode, "b"))
+    {
+        fseek(fp, 0, SEEK_END);
+        size_t file_size = (size_t)ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+    
+        dstr = alloc_setup_capacity(file_size);
+
+        fread(dstr->data, dstr->size + 1, 1, fp);
+    }
+    else
+    {
+        dstr = alloc_read_file_content(fp);
+    }
+
+    fclose(fp);
+
+    return dstr;
+}
+
+void dstr_write_file(dstr_t *dstr, const char *path, const char *mode)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(path, __func__)
+        || is_not_valid_str(mode, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    if (strstr(mode, "r") != NULL || strstr(mode, "+") != NULL)
+    {
+        printf("%s: %swarning:%s file can not be read%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
+
+    FILE *fp = fopen(path, mode);
+
+    if (fp == NULL) 
+    {
+        printf("%s: %swarning:%s failed to write content%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
+
+    if (strstr(mode, "b"))
+    {
+        fwrite(dstr->data, dstr->size + 1, 1, fp);
+    }
+    else
+    {
+        fwrite(dstr->data, dstr->size, 1, fp);
+    }
+
+    fclose(fp);
+}
+
+dstr_t *dstr_alloc_sys_output(const char *cmd)
+{
+    if (is_not_valid_str(cmd, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    FILE *fp = popen(cmd, "r");
+    dstr_t *dstr = alloc_read_file_content(fp);
+
+    if (fp != NULL)
+    {
+        pclose(fp);
+    }
+
+    return dstr;
+}
+
+bool dstr_getline(dstr_t *dstr, FILE *fp)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_pointer_null(fp, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(0);
+
+    return read_stream_line(dstr, fp);
+}
+
+size_t dstr_ascii_total(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return sum_bytes(dstr->data, dstr->size);
+}
+
+// total is what the chunks before added up to, 0 at the start.
+size_t dstr_ascii_total_update(size_t total, const char *data, size_t size)
+{
+    if (data == NULL && size > 0)
+    {
+        is_str_null(data, __func__);
+        return total;
+    }
+
+    PROFILE_FUNC(size);
+
+    return total + sum_bytes(data, size);
+}
+
+uint32_t dstr_crc32c(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return update_crc32c(0, dstr->data, dstr->size);
+}
+
+// crc is the crc32c of the chunks before, 0 at the start.
+uint32_t dstr_crc32c_update(uint32_t crc, const char *data, size_t size)
+{
+    if (data == NULL && size > 0)
+    {
+        is_str_null(data, __func__);
+        return crc;
+    }
+
+    PROFILE_FUNC(size);
+
+    return update_crc32c(crc, data, size);
+}
+
+uint64_t dstr_digest64(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return digest_str(dstr->data, dstr->size, 0);
+}
+
+dstr_digest_t *dstr_digest_alloc(uint64_t seed)
+{
+    PROFILE_FUNC(0);
+
+    dstr_digest_t *digest = mem_alloc(sizeof(dstr_digest_t));
+    setup_digest(digest, seed);
+
+    return digest;
+}
+
+void dstr_digest_update(dstr_digest_t *digest, const char *data, size_t size)
+{
+    if (is_digest_null(digest, __func__))
+    {
+        return;
+    }
+    else if (data == NULL && size > 0)
+    {
+        is_str_null(data, __func__);
+        return;
+    }
+
+    PROFILE_FUNC(size);
+
+    update_digest(digest, data, size);
+}
+
+uint64_t dstr_digest_get(dstr_digest_t *digest)
+{
+    if (is_digest_null(digest, __func__))
+    {
+        return 0;
+    }
+
+    return get_digest(digest);
+}
+
+void dstr_digest_free(dstr_digest_t **digest)
+{
+    if (is_pointer_null(digest, __func__)
+        || is_digest_null(*digest, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    mem_free(*digest, sizeof(dstr_digest_t));
+    *digest = NULL;
+}
+
+int64_t dstr_ll(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return strtoll(dstr->data, NULL, 10);
+}
+
+double dstr_double(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0.0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return strtod(dstr->data, NULL);
+}
+
+dstr_t *dstr_alloc_ll_to_dstr(int64_t number)
+{
+    PROFILE_FUNC(0);
+
+    dstr_t *digits = dstr_alloc("");
+
+    while (number > 0)
+    {
+        dstr_before(digits, get_str_number((number % 10)));
+        number /= 10;
+    }
+
+    return digits;
+}
+
+dstr_t *dstr_alloc_ll_to_binary_dstr(int64_t number, size_t bits_shown)
+{
+    PROFILE_FUNC(0);
+
+    dstr_t *bi_num = dstr_alloc("");
+
+    while (number > 0)
+    {
+        dstr_before(bi_num, get_str_number(number % 2));
+        number /= 2;
+    }
+
+    if (bits_shown > bi_num->size)
+    {
+        bits_shown -= bi_num->size;
+
+        for (size_t i = 0; i < bits_shown; i++)
+        {
+            dstr_before(bi_num, "0");
+        }
+    }
+
+    return bi_num;
+}
+
+dstr_t *dstr_alloc_str_to_binary_dstr(const char *number, size_t bits_shown)
+{
+    if (is_not_valid_str(number, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    return dstr_alloc_ll_to_binary_dstr(strtoll(number, NULL, 10), bits_shown);
+}
+
+dstr_t *dstr_alloc_dstr_to_binary_dstr(dstr_t *dstr, size_t bits_shown)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return dstr_alloc_ll_to_binary_dstr(dstr_ll(dstr), bits_shown);
+}
+
+bool dstr_utf8_is_valid(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return is_valid_utf8(dstr->data, dstr->size);
+}
+
+size_t dstr_utf8_len(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return get_utf8_index(dstr)->length;
+}
+
+size_t dstr_utf8_offset(dstr_t *dstr, int64_t index)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    utf8_index_t *utf8_index = get_utf8_index(dstr);
+
+    if (check_index(&index, utf8_index->length, __func__))
+    {
+        return 0;
+    }
+
+    return get_utf8_offset(dstr, utf8_index, (size_t)index);
+}
+
+uint32_t dstr_utf8_char_at(dstr_t *dstr, int64_t index)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    utf8_index_t *utf8_index = get_utf8_index(dstr);
+
+    if (check_index(&index, utf8_index->length, __func__))
+    {
+        return 0;
+    }
+
+    size_t offset = get_utf8_offset(dstr, utf8_index, (size_t)index);
+
+    return decode_utf8(&dstr->data[offset], dstr->size - offset);
+}
+
+dstr_t *dstr_alloc_utf8_subdstr(dstr_t *dstr, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_size_zero(dstr->size, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    int64_t step = 0;
+
+    if (get_step(step_opt, &step, __func__))
+    {
+        return NULL;
+    }
+
+    utf8_index_t *utf8_index = get_utf8_index(dstr);
+    bool is_step_neg = (step < 0);
+    int64_t start = get_start_index(start_opt, utf8_index->length, is_step_neg);
+    int64_t end = get_end_index(end_opt, utf8_index->length, is_step_neg, start);
+    size_t size = get_sub_size(start, end, is_step_neg);
+
+    if (size == 0)
+    {
+        return dstr_alloc("");
+    }
+
+    // A unit step covers one contiguous run of bytes, so it's sized exactly.
+    if (step == 1)
+    {
+        size_t span_start = get_utf8_offset(dstr, utf8_index, (size_t)start);
+        size_t span_end = get_utf8_offset(dstr, utf8_index, (size_t)start + size);
+
+        return alloc_sized_dstr(&dstr->data[span_start], span_end - span_start);
+    }
+    else if (step == -1)
+    {
+        return alloc_reversed_utf8(dstr, get_utf8_offset(dstr, utf8_index, (size_t)(end + 1)), get_utf8_offset(dstr, utf8_index, (size_t)start + 1));
+    }
+
+    size_t abs_step = (step < 0) ? (size_t)(step * -1) : (size_t)step;
+    size_t num_of_chars = (abs_step >= size) ? 1 : ceil_lu(size, abs_step);
+
+    // Sized for the average bytes per codepoint and grown if the picked
+    // codepoints turn out to be longer.
+    size_t bytes_per_char = ceil_lu(dstr->size, utf8_index->length);
+    size_t sub_size = 0;
+    dstr_t *dsub_str = alloc_setup_capacity((num_of_chars < dstr->size / bytes_per_char) ? num_of_chars * bytes_per_char : dstr->size);
+
+    for (size_t i = 0; i < num_of_chars; i++)
+    {
+        size_t char_start = get_utf8_offset(dstr, utf8_index, (size_t)start);
+        size_t char_size = get_utf8_char_end(dstr->data, dstr->size, char_start) - char_start;
+
+        reserve_dstr_data(dsub_str, sub_size + char_size);
+        memcpy(&dsub_str->data[sub_size], &dstr->data[char_start], char_size);
+        sub_size += char_size;
+        start += step;
+    }
+
+    set_dstr_size(dsub_str, sub_size);
+    dsub_str->data[sub_size] = '\0';
+
+    return dsub_str;
+}
+
+uint64_t dstr_hash(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    return get_dstr_hash(dstr);
+}
+
+uint64_t dstr_hash_str(const char *data, size_t size)
+{
+    if (is_str_null(data, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(size);
+
+    return hash_bytes(data, size);
+}
+
+bool dstr_is_digit(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return (get_str_classes(dstr->data, dstr->size, DSTR_CLASS_DIGIT) & DSTR_CLASS_DIGIT) != 0;
+}
+
+bool dstr_is_alpha(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return (get_str_classes(dstr->data, dstr->size, DSTR_CLASS_ALPHA) & DSTR_CLASS_ALPHA) != 0;
+}
+
+bool dstr_is_alnum(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return (get_str_classes(dstr->data, dstr->size, DSTR_CLASS_ALNUM) & DSTR_CLASS_ALNUM) != 0;
+}
+
+bool dstr_is_space(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return (get_str_classes(dstr->data, dstr->size, DSTR_CLASS_SPACE) & DSTR_CLASS_SPACE) != 0;
+}
+
+bool dstr_is_upper(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return (get_str_classes(dstr->data, dstr->size, DSTR_CLASS_UPPER) & DSTR_CLASS_UPPER) != 0;
+}
+
+bool dstr_is_lower(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return (get_str_classes(dstr->data, dstr->size, DSTR_CLASS_LOWER) & DSTR_CLASS_LOWER) != 0;
+}
+
+bool dstr_is_ascii(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return (get_str_classes(dstr->data, dstr->size, DSTR_CLASS_ASCII) & DSTR_CLASS_ASCII) != 0;
+}
+
+uint8_t dstr_classify(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return get_str_classes(dstr->data, dstr->size, DSTR_CLASS_ALL);
+}
+
+bool dstr_view_is_digit(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return (get_str_classes(view.data, view.size, DSTR_CLASS_DIGIT) & DSTR_CLASS_DIGIT) != 0;
+}
+
+bool dstr_view_is_alpha(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return (get_str_classes(view.data, view.size, DSTR_CLASS_ALPHA) & DSTR_CLASS_ALPHA) != 0;
+}
+
+bool dstr_view_is_alnum(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return (get_str_classes(view.data, view.size, DSTR_CLASS_ALNUM) & DSTR_CLASS_ALNUM) != 0;
+}
+
+bool dstr_view_is_space(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return (get_str_classes(view.data, view.size, DSTR_CLASS_SPACE) & DSTR_CLASS_SPACE) != 0;
+}
+
+bool dstr_view_is_upper(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return (get_str_classes(view.data, view.size, DSTR_CLASS_UPPER) & DSTR_CLASS_UPPER) != 0;
+}
+
+bool dstr_view_is_lower(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return (get_str_classes(view.data, view.size, DSTR_CLASS_LOWER) & DSTR_CLASS_LOWER) != 0;
+}
+
+bool dstr_view_is_ascii(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return (get_str_classes(view.data, view.size, DSTR_CLASS_ASCII) & DSTR_CLASS_ASCII) != 0;
+}
+
+uint8_t dstr_view_classify(dstr_view_t view)
+{
+    if (is_str_null(view.data, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(view.size);
+
+    return get_str_classes(view.data, view.size, DSTR_CLASS_ALL);
+}
+
+dstr_t *dstr_alloc_copy(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return dstr_alloc(dstr->data);
+}
+
+void dstr_print(dstr_t *dstr, const char *beginning, const char *end)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_str_null(beginning, __func__)
+        || is_str_null(end, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    fputs(beginning, stdout);
+    fwrite(dstr->data, dstr->size, 1, stdout);
+    fputs(end, stdout);
+}
+
+void dstr_free(dstr_t **dstr)
+{
+    if (is_pointer_null(dstr, __func__)
+        || is_dstr_null(*dstr, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC((*dstr)->size);
+
+    invalidate_cached(*dstr);
+    dstr_data_free(*dstr);
+    set_dstr_data(*dstr, NULL, 0);
+    set_dstr_size(*dstr, 0);
+    free_dstr(*dstr);
+    *dstr = NULL;
+}
+
+
+/*
+void sa_set_size(dstr_arr_t *dstr_array, int64_t size)
+{
+    if (str_array == NULL)
+    {
+        printf("%s: %swarning:%s string_array is NULL%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
 
-    while (data_copy != NULL && occurrences < end)
+    str_array->size = size;
+}
+
+void sa_set_index(dstr_arr_t d*str_array, int64_t index, dstr_t *dstr)
+{
+    if (check_index(&index, str_array->size, __func__))
     {
-        data_copy += search_val_size;
-        data_copy = strstr(data_copy, search_val);
-        occurrences++;
+        return;
+    }
+    else if (str_array == NULL)
+    {
+        printf("%s: %swarning:%s string_array is NULL%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
+
+    str_array->data_set[index] = str;
+}
+*/
+
+void dstr_arr_set_dstr(dstr_arr_t *dstr_array, int64_t index, dstr_t *dstr_input)
+{
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || check_index(&index, dstr_array->size, __func__)
+        || is_dstr_null(dstr_input, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_free(&dstr_array->data_set[index]);
+    dstr_array->data_set[index] = dstr_input;
+}
+
+void dstr_arr_set(dstr_arr_t *dstr_array, int64_t index, const char *data)
+{
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || check_index(&index, dstr_array->size, __func__)
+        || is_str_null(data, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_free(&dstr_array->data_set[index]);
+    dstr_array->data_set[index] = dstr_alloc(data);
+}
+
+size_t dstr_arr_get_size(dstr_arr_t *dstr_array)
+{
+    if (is_dstr_arr_null(dstr_array, __func__))
+    {
+        return 0;
+    }
+
+    return dstr_array->size;
+}
+
+dstr_t *dstr_arr_get_index(dstr_arr_t *dstr_array, int64_t index)
+{
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || check_index(&index, dstr_array->size, __func__))
+    {
+        return NULL;
+    }
+
+    return dstr_array->data_set[index];
+}
+
+dstr_arr_t *dstr_arr_alloc(size_t size)
+{
+    if (is_size_zero(size, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_arr_t *dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    dstr_array->size = size;
+    dstr_array->data_set = mem_alloc(dstr_array->size * sizeof(dstr_t*));
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        dstr_array->data_set[i] = dstr_alloc("");
+    }
+
+    return dstr_array;
+}
+
+dstr_arr_t *dstr_arr_alloc_strs(size_t size, ...)
+{
+    if (is_size_zero(size, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_arr_t *dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    dstr_array->size = size;
+    dstr_array->data_set = mem_alloc(dstr_array->size * sizeof(dstr_t*));
+
+    va_list args;
+    va_start(args, size);
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        dstr_array->data_set[i] = dstr_alloc(va_arg(args, char*));
+    }
+
+    va_end(args);
+
+    return dstr_array;
+}
+
+dstr_arr_t *dstr_arr_alloc_dstrs(size_t size, ...)
+{
+    if (is_size_zero(size, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_arr_t *dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    dstr_array->size = size;
+    dstr_array->data_set = mem_alloc(dstr_array->size * sizeof(dstr_t*));
+
+    va_list args;
+    va_start(args, size);
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        dstr_array->data_set[i] = va_arg(args, dstr_t*);
+    }
+
+    va_end(args);
+
+    return dstr_array;
+}
+
+dstr_arr_t *dstr_alloc_splitstr(const char *data, const char *separator, size_t max_split)
+{
+    if (is_not_valid_str(data, __func__)
+        || is_not_valid_str(separator, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    return alloc_split_str(data, strlen(data), separator, max_split);
+}
+
+dstr_arr_t *dstr_alloc_splitdstr(dstr_t *dstr, const char *separator, size_t max_split)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(separator, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return alloc_split_str(dstr->data, dstr->size, separator, max_split);
+}
+
+dstr_arr_t *dstr_split_parallel(dstr_t *dstr, const char *separator, size_t num_of_threads)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(separator, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    num_of_threads = get_num_of_threads(num_of_threads, dstr->size);
+
+    size_t num_of_fields = 0;
+    scan_chunk_t *chunks = alloc_scan_chunks(dstr->data, dstr->size, separator, num_of_threads);
+
+    run_in_pool(find_chunk_matches, chunks, sizeof(scan_chunk_t), num_of_threads);
+
+    size_t field_start = fix_scan_chunks(chunks, num_of_threads, 0, &num_of_fields);
+
+    dstr_arr_t *dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    dstr_array->size = num_of_fields + 1;
+    dstr_array->data_set = mem_alloc(dstr_array->size * sizeof(dstr_t*));
+
+    for (size_t i = 0, offset = 0; i < num_of_threads; i++)
+    {
+        chunks[i].fields = &dstr_array->data_set[offset];
+        offset += chunks[i].matches.size;
+    }
+
+    run_in_pool(alloc_split_fields, chunks, sizeof(scan_chunk_t), num_of_threads);
+
+    dstr_array->data_set[num_of_fields] = alloc_sized_dstr(&dstr->data[field_start], dstr->size - field_start);
+    free_scan_chunks(chunks, num_of_threads);
+
+    return dstr_array;
+}
+
+dstr_arr_t *dstr_split_whitespace(dstr_t *dstr, size_t max_split)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return split_whitespace(dstr->data, dstr->size, max_split);
+}
+
+dstr_arr_t *dstr_rsplit_whitespace(dstr_t *dstr, size_t max_split)
+{
+    if (is_dstr_null(dstr, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return rsplit_whitespace(dstr->data, dstr->size, max_split);
+}
+
+dstr_arr_t *dstr_split_any(dstr_t *dstr, const char *charset, size_t max_split)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(charset, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return split_any(dstr->data, dstr->size, charset, max_split);
+}
+
+dstr_arr_t *dstr_rsplit_any(dstr_t *dstr, const char *charset, size_t max_split)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_not_valid_str(charset, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    return rsplit_any(dstr->data, dstr->size, charset, max_split);
+}
+
+dstr_arr_t *dstr_arr_alloc_prompt(size_t size, ...)
+{
+    if (is_size_zero(size, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_arr_t *dstr_array = dstr_arr_alloc(size);
+
+    va_list args;
+    va_start(args, size);
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        dstr_arr_set_dstr(dstr_array, (int64_t)i, dstr_alloc_prompt(va_arg(args, char*)));
+    }
+
+    va_end(args);
+
+    return dstr_array;
+}
+
+dstr_arr_t *dstr_arr_read_lines(FILE *fp)
+{
+    if (is_pointer_null(fp, __func__))
+    {
+        return NULL;
+    }
+
+    PROFILE_FUNC(0);
+
+    dstr_t *content = alloc_dstr();
+
+    set_empty_dstr(content);
+    append_stream(content, fp);
+
+    const char *data = content->data;
+    const char *end = data + content->size;
+    size_t num_of_lines = count_in_str(data, content->size, "\n");
+
+    if (content->size > 0 && end[-1] != '\n')
+    {
+        num_of_lines++;
     }
 
-    if (count > 0 && count < occurrences)
+    dstr_arr_t *dstr_array = alloc_sized_dstr_arr(num_of_lines);
+
+    for (size_t i = 0; i < num_of_lines; i++)
     {
-        occurrences = count;
+        const char *line_end = memchr(data, '\n', (size_t)(end - data));
+
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+
+        dstr_array->data_set[i] = alloc_sized_dstr(data, (size_t)(line_end - data));
+        data = line_end + 1;
     }
 
-    free_mem(data_alloc, sizeof(char) * (data_size + 1));
+    dstr_free(&content);
 
-    return occurrences;
+    return dstr_array;
 }
 
-static dstr_t *alloc_read_file_content(FILE *fp)
+dstr_arr_t *dstr_arr_read_files(const char **paths, size_t num_of_paths, const char *mode)
 {
-    char line[STR_MAX_CHARS] = {0};
-    dstr_t *dstr = dstr_alloc("");
+    if (is_pointer_null(paths, __func__)
+        || is_size_zero(num_of_paths, __func__)
+        || is_not_valid_str(mode, __func__))
+    {
+        return NULL;
+    }
 
-    if (fp == NULL) 
+    for (size_t i = 0; i < num_of_paths; i++)
     {
-        printf("%s: %swarning:%s failed to read content%s\n", __func__, PURPLE, WHITE, RESET);
+        if (is_not_valid_str(paths[i], __func__))
+        {
+            return NULL;
+        }
+    }
+
+    if (strstr(mode, "w") != NULL || strstr(mode, "a") != NULL)
+    {
+        printf("%s: %swarning:%s file can not be written%s\n", __func__, PURPLE, WHITE, RESET);
         return NULL;
     }
 
-    while (prompt_getline_stream("", line, STR_MAX_CHARS, fp) != EOF)
+    PROFILE_FUNC(0);
+
+    file_task_t *tasks = mem_alloc(num_of_paths * sizeof(file_task_t));
+    bool is_binary = (strstr(mode, "b") != NULL);
+
+    for (size_t i = 0; i < num_of_paths; i++)
+    {
+        tasks[i] = (file_task_t){paths[i], is_binary, false, NULL};
+    }
+
+    run_in_pool(read_file_task, tasks, sizeof(file_task_t), num_of_paths);
+
+    dstr_arr_t *dstr_array = mem_alloc(sizeof(dstr_arr_t));
+    dstr_array->size = num_of_paths;
+    dstr_array->data_set = mem_alloc(num_of_paths * sizeof(dstr_t*));
+
+    for (size_t i = 0; i < num_of_paths; i++)
     {
-        if (line[0] != '\0')
+        if (tasks[i].is_failed)
         {
-            dstr_append(dstr, line);
+            printf("%s: %swarning:%s failed to read %s%s\n", __func__, PURPLE, WHITE, paths[i], RESET);
         }
 
-        dstr_append(dstr, "\n");
+        dstr_array->data_set[i] = tasks[i].dstr;
     }
 
-    return dstr;
+    mem_free(tasks, num_of_paths * sizeof(file_task_t));
+
+    return dstr_array;
 }
 
-static dstr_arr_t *alloc_split_str(const char *data, size_t size, const char *separator, size_t max_split)
+bool dstr_arr_cmp(dstr_arr_t *dstr_array, int64_t index, const char *data)
 {
-    size_t i = 0;
-    char *data_alloc = strdup(data);
-    char *data_copy = data_alloc;
-    size_t num_of_occurrences = count_occurrences_in_str(data_copy, separator, max_split, 0, size);
+    if (is_str_null(data, __func__)
+        || is_dstr_arr_null(dstr_array, __func__)
+        || check_index(&index, dstr_array->size, __func__))
+    {
+        return false;
+    }
 
-    add_to_allocated(sizeof(char) * (size + 1));
+    PROFILE_FUNC(0);
 
-    dstr_arr_t *dstr_array = alloc_mem(sizeof(dstr_arr_t));
-    dstr_array->size = num_of_occurrences + 1;
-    dstr_array->data_set = alloc_mem(dstr_array->size * sizeof(dstr_t*));
+    return !(strcmp(data, (dstr_array->data_set[index]->data)));
+}
 
-    while (i < num_of_occurrences)
+bool dstr_arr_cmp_dstr(dstr_arr_t *dstr_array, int64_t index, dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__)
+        || is_dstr_arr_null(dstr_array, __func__)
+        || check_index(&index, dstr_array->size, __func__))
     {
-        dstr_array->data_set[i] = dstr_alloc(strsep_chars(&data_copy, separator));
-        i++;
+        return false;
     }
 
-    dstr_array->data_set[i] = dstr_alloc(data_copy);
-    free_mem(data_alloc, sizeof(char) * (size + 1));
+    PROFILE_FUNC(dstr->size);
 
-    return dstr_array;
+    return !(strcmp(dstr->data, (dstr_array->data_set[index]->data)));
 }
 
-static size_t update_capacity(size_t size, size_t capacity)
+void dstr_arr_print(dstr_arr_t *dstr_array, const char *beginning, const char *end)
 {
-    while (size > capacity)
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || is_str_null(beginning, __func__)
+        || is_str_null(end, __func__))
     {
-        capacity *= 2;
+        return;
     }
 
-    return capacity;
+    PROFILE_FUNC(0);
+
+    fputs(beginning, stdout);
+    fputs("{", stdout);
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        fputs((i == 0) ? "\"" : ", \"", stdout);
+        fwrite(dstr_array->data_set[i]->data, dstr_array->data_set[i]->size, 1, stdout);
+        fputs("\"", stdout);
+    }
+
+    fputs("}", stdout);
+    fputs(end, stdout);
 }
 
-static size_t calculate_capacity(size_t size)
+void dstr_arr_free(dstr_arr_t **dstr_array)
 {
-    return update_capacity(size, DEFAULT_CAPACITY);
+    if (is_pointer_null(dstr_array, __func__)
+        || is_dstr_arr_null(*dstr_array, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    for (size_t i = 0; i < (*dstr_array)->size; i++)
+    {
+        dstr_free(&(*dstr_array)->data_set[i]);
+    }
+
+    mem_free((*dstr_array)->data_set, (*dstr_array)->size * sizeof(dstr_t*));
+    mem_free(*dstr_array, sizeof(dstr_arr_t));
+    *dstr_array = NULL;
 }
 
-static void set_empty_dstr(dstr_t *dstr)
+bool dstr_arr_write_lines(dstr_arr_t *dstr_array, int fd)
 {
-    dstr->size = 0;
-    dstr->capacity = DEFAULT_CAPACITY;
-    dstr->data = alloc_mem(sizeof(char) * (dstr->capacity + 1));
-    dstr->data[0] = '\0';
+    if (is_dstr_arr_null(dstr_array, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(0);
+
+    // Every line is two iovecs, the dstr's own data and a shared newline.
+    static char newline[] = "\n";
+    struct iovec *iov = mem_alloc(sizeof(struct iovec) * WRITER_MAX_IOVECS);
+    bool is_written = true;
+
+    for (size_t i = 0; i < dstr_array->size && is_written; i += WRITER_MAX_IOVECS / 2)
+    {
+        size_t num_of_lines = (dstr_array->size - i > WRITER_MAX_IOVECS / 2) ? WRITER_MAX_IOVECS / 2 : dstr_array->size - i;
+
+        for (size_t j = 0; j < num_of_lines; j++)
+        {
+            iov[2 * j].iov_base = dstr_array->data_set[i + j]->data;
+            iov[2 * j].iov_len = dstr_array->data_set[i + j]->size;
+            iov[(2 * j) + 1].iov_base = newline;
+            iov[(2 * j) + 1].iov_len = 1;
+        }
+
+        is_written = write_iovecs(fd, iov, 2 * num_of_lines);
+    }
+
+    if (!(is_written))
+    {
+        printf("%s: %swarning:%s failed to write content%s\n", __func__, PURPLE, WHITE, RESET);
+    }
+
+    mem_free(iov, sizeof(struct iovec) * WRITER_MAX_IOVECS);
+
+    return is_written;
 }
 
-static dstr_t *alloc_substr(const char *data, size_t data_size, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt, const char *func_name)
+// Writes to a temporary file next to path and renames it over path,
+// so a reader never maps a half written snapshot.
+bool dstr_arr_save_snapshot(dstr_arr_t *dstr_array, const char *path)
 {
-    if (is_size_zero(data_size, func_name))
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || is_not_valid_str(path, __func__))
     {
-        return NULL;
+        return false;
     }
 
-    int64_t step = 0;
+    PROFILE_FUNC(0);
 
-    if (step_opt == NULL)
+    size_t blob_size = 0;
+    size_t map_size = get_snapshot_size(dstr_array, &blob_size);
+    size_t path_size = strlen(path);
+    char *tmp_path = mem_alloc(sizeof(char) * (path_size + 5));
+
+    memcpy(tmp_path, path, path_size);
+    memcpy(&tmp_path[path_size], ".tmp", 5);
+
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    char *map = MAP_FAILED;
+
+    if (fd != -1 && ftruncate(fd, (off_t)map_size) == 0)
     {
-        step = 1;
+        map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     }
-    else if (*step_opt == 0)
+
+    bool is_saved = (map != MAP_FAILED);
+
+    if (is_saved)
     {
-        printf("%s: %swarning:%s slice step cannot be equal to zero%s\n", func_name, PURPLE, WHITE, RESET);
-        return NULL;
+        fill_snapshot(map, dstr_array, blob_size);
+        is_saved = (munmap(map, map_size) == 0);
+    }
+
+    // The data has to be on disk before the rename makes it the snapshot,
+    // or a crash could leave a renamed file with holes in it.
+    if (fd != -1)
+    {
+        is_saved = is_saved && (fsync(fd) == 0);
+        is_saved = (close(fd) == 0) && is_saved;
+    }
+
+    is_saved = is_saved && (rename(tmp_path, path) == 0);
+
+    if (!is_saved)
+    {
+        printf("%s: %swarning:%s failed to save snapshot%s\n", __func__, PURPLE, WHITE, RESET);
+        unlink(tmp_path);
+    }
+
+    mem_free(tmp_path, sizeof(char) * (path_size + 5));
+
+    return is_saved;
+}
+
+void dstr_arr_parallel_for_each(dstr_arr_t *dstr_array, void (*func)(dstr_t *dstr, void *context), void *context)
+{
+    if (is_dstr_arr_null(dstr_array, __func__))
+    {
+        return;
+    }
+    else if (func == NULL)
+    {
+        printf("%s: %swarning:%s func is NULL%s\n", __func__, PURPLE, WHITE, RESET);
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    size_t num_of_ranges = get_num_of_participants();
+    element_range_t *ranges = mem_alloc(sizeof(element_range_t) * num_of_ranges);
+    for_each_job_t job = {dstr_array->data_set, func, context, num_of_ranges, ranges};
+
+    // Every thread starts on an equal share, and the ones
+    // with cheaper elements steal from the others.
+    for (size_t i = 0; i < num_of_ranges; i++)
+    {
+        pthread_mutex_init(&ranges[i].lock, NULL);
+        ranges[i].start = (dstr_array->size / num_of_ranges) * i;
+        ranges[i].end = (i + 1 == num_of_ranges) ? dstr_array->size : (dstr_array->size / num_of_ranges) * (i + 1);
+    }
+
+    if (dstr_array->size <= FOR_EACH_GRAIN_SIZE)
+    {
+        run_for_each(&job, 0);
     }
     else
     {
-        step = *step_opt;
+        run_pool_job(run_for_each, &job);
     }
 
-    bool is_step_neg = (step < 0);
-    int64_t start = get_start_index(start_opt, data_size, is_step_neg);
-    int64_t end = get_end_index(end_opt, data_size, is_step_neg, start);
-    size_t size = get_sub_size(start, end, is_step_neg);
-    dstr_t *dsub_str = alloc_mem(sizeof(dstr_t));
+    for (size_t i = 0; i < num_of_ranges; i++)
+    {
+        pthread_mutex_destroy(&ranges[i].lock);
+    }
 
-    if (size == 0)
+    mem_free(ranges, sizeof(element_range_t) * num_of_ranges);
+}
+
+void dstr_arr_strip_all(dstr_arr_t *dstr_array)
+{
+    if (is_dstr_arr_null(dstr_array, __func__))
     {
-        set_empty_dstr(dsub_str);
-        return dsub_str;
+        return;
     }
 
-    size_t abs_step = (step < 0) ? (size_t)(step * -1) : (size_t)step;
+    dstr_arr_parallel_for_each(dstr_array, strip_element, NULL);
+}
+
+void dstr_arr_strip_chars_all(dstr_arr_t *dstr_array, const char *characters)
+{
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || is_not_valid_str(characters, __func__))
+    {
+        return;
+    }
 
-    dsub_str->size = (abs_step >= size) ? 1 : ceil_lu(size, abs_step);
-    dsub_str->capacity = calculate_capacity(dsub_str->size);
-    dsub_str->data = alloc_mem(sizeof(char) * (dsub_str->capacity + 1));
+    dstr_arr_parallel_for_each(dstr_array, strip_chars_element, (void*)characters);
+}
 
-    for (size_t i = 0; i < dsub_str->size; i++)
+void dstr_arr_lower_all(dstr_arr_t *dstr_array)
+{
+    if (is_dstr_arr_null(dstr_array, __func__))
     {
-        dsub_str->data[i] = data[start];
-        start += step;
+        return;
     }
 
-    dsub_str->data[dsub_str->size] = '\0';
+    dstr_arr_parallel_for_each(dstr_array, lower_element, NULL);
+}
 
-    return dsub_str;
+void dstr_arr_upper_all(dstr_arr_t *dstr_array)
+{
+    if (is_dstr_arr_null(dstr_array, __func__))
+    {
+        return;
+    }
+
+    dstr_arr_parallel_for_each(dstr_array, upper_element, NULL);
 }
 
-static char *get_str_number(int8_t number)
+void dstr_arr_replace_all(dstr_arr_t *dstr_array, const char *old_str, const char *new_str)
 {
-    switch (number)
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || is_not_valid_str(old_str, __func__)
+        || is_str_null(new_str, __func__))
     {
-        case 0:
-            return "0";
-        case 1:
-            return "1";
-        case 2:
-            return "2";
-        case 3:
-            return "3";
-        case 4:
-            return "4";
-        case 5:
-            return "5";
-        case 6:
-            return "6";
-        case 7:
-            return "7";
-        case 8:
-            return "8";
-        case 9:
-            return "9";
+        return;
     }
 
-    return "";
+    replace_context_t context = {old_str, new_str};
+
+    dstr_arr_parallel_for_each(dstr_array, replace_element, &context);
 }
 
-static size_t dstr_realloc_capacity(dstr_t *dstr, const char *data)
+void dstr_arr_sort(dstr_arr_t *dstr_array, bool is_parallel)
 {
-    size_t old_capacity = 0;
-    size_t data_size = strlen(data);
-    dstr->size += data_size;
+    if (is_dstr_arr_null(dstr_array, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    sort_dstr_arr(dstr_array, false, is_parallel);
+}
+
+void dstr_arr_sort_stable(dstr_arr_t *dstr_array, bool is_parallel)
+{
+    if (is_dstr_arr_null(dstr_array, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    sort_dstr_arr(dstr_array, true, is_parallel);
+}
+
+size_t dstr_arr_sort_unique(dstr_arr_t *dstr_array, bool is_parallel)
+{
+    if (is_dstr_arr_null(dstr_array, __func__))
+    {
+        return 0;
+    }
+
+    PROFILE_FUNC(0);
+
+    // Stable, so the first of each run of equal dstrs is the one kept.
+    sort_dstr_arr(dstr_array, true, is_parallel);
+
+    size_t old_size = dstr_array->size;
+    size_t size = (old_size > 0) ? 1 : 0;
+
+    for (size_t i = 1; i < old_size; i++)
+    {
+        dstr_t *last = dstr_array->data_set[size - 1];
+        dstr_t *dstr = dstr_array->data_set[i];
+
+        if (dstr->size == last->size && memcmp(dstr->data, last->data, dstr->size) == 0)
+        {
+            dstr_free(&dstr_array->data_set[i]);
+        }
+        else
+        {
+            dstr_array->data_set[size++] = dstr;
+        }
+    }
 
-    if (dstr->size > dstr->capacity)
+    if (size < old_size)
     {
-        old_capacity = dstr->capacity;
-        dstr->capacity = update_capacity(dstr->size, dstr->capacity);
-        dstr->data = realloc(dstr->data, sizeof(char) * (dstr->capacity + 1));
-
-        add_to_allocated(sizeof(char) * (dstr->capacity - old_capacity));
+        dstr_array->data_set = mem_realloc(dstr_array->data_set, old_size * sizeof(dstr_t*), size * sizeof(dstr_t*));
+        dstr_array->size = size;
     }
 
-    return data_size;
+    return size;
 }
 
-static void dstr_data_free(dstr_t *dstr)
+void dstr_arr_classify(dstr_arr_t *dstr_array, uint8_t *classes)
 {
-    free_mem(dstr->data, sizeof(char) * (dstr->capacity + 1));
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || is_pointer_null(classes, __func__))
+    {
+        return;
+    }
+
+    PROFILE_FUNC(0);
+
+    for (size_t i = 0; i < dstr_array->size; i++)
+    {
+        dstr_t *dstr = dstr_array->data_set[i];
+        classes[i] = get_str_classes(dstr->data, dstr->size, DSTR_CLASS_ALL);
+    }
 }
 
-static dstr_t *alloc_setup_capacity(size_t file_size)
+dstr_index_arr_t *dstr_index_arr_alloc(void)
 {
-    dstr_t *dstr = alloc_mem(sizeof(dstr_t));
+    PROFILE_FUNC(0);
 
-    dstr->size = file_size;
-    dstr->capacity = calculate_capacity(file_size);
-    dstr->data = alloc_mem(sizeof(char) * (dstr->capacity + 1));
+    dstr_index_arr_t *index_array = mem_alloc(sizeof(dstr_index_arr_t));
 
-    return dstr;
+    index_array->size = 0;
+    index_array->capacity = DEFAULT_CAPACITY;
+    index_array->data = mem_alloc(sizeof(size_t) * index_array->capacity);
+
+    return index_array;
 }
 
-size_t str_ascii_total(const char *data)
+size_t dstr_index_arr_get_size(dstr_index_arr_t *index_array)
 {
-    if (is_not_valid_str(data, __func__))
+    if (is_index_arr_null(index_array, __func__))
     {
         return 0;
     }
 
-    size_t ascii_total = 0;
+    return index_array->size;
+}
 
-    while (*data != '\0')
+size_t dstr_index_arr_get_index(dstr_index_arr_t *index_array, int64_t index)
+{
+    if (is_index_arr_null(index_array, __func__)
+        || check_index(&index, index_array->size, __func__))
     {
-        ascii_total += (size_t)*data;
-        data++;
+        return 0;
     }
 
-    return ascii_total;
+    return index_array->data[index];
 }
 
-/*
-void dstr_set_size(dstr_t *dstr, int64_t size)
+const size_t *dstr_index_arr_get_data(dstr_index_arr_t *index_array)
 {
-    if (check_warnings(str, STR_NULL, __func__))
-    {
-        return;
-    }
-    else if (size < 0)
+    if (is_index_arr_null(index_array, __func__))
     {
-        printf("%s: %swarning:%s size is less than 0%s\n", __func__, PURPLE, WHITE, RESET);
-        return;
+        return NULL;
     }
 
-    str->size = size;
+    return index_array->data;
 }
 
-void dstr_set_capacity(dstr_t *dstr, int64_t capacity)
+void dstr_index_arr_clear(dstr_index_arr_t *index_array)
 {
-    if (check_warnings(str, STR_NULL, __func__))
-    {
-        return;
-    }
-    else if (capacity < 0)
+    if (is_index_arr_null(index_array, __func__))
     {
-        printf("%s: %swarning:%s capacity is less than 0%s\n", __func__, PURPLE, WHITE, RESET);
         return;
     }
 
-    str->capacity = capacity;
+    index_array->size = 0;
 }
 
-void dstr_set_literal(dstr_t *dstr, char *data)
+void dstr_index_arr_free(dstr_index_arr_t **index_array)
 {
-    if (check_warnings(str, STR_NULL, __func__))
-    {
-        return;
-    }
-    else if (is_not_valid_str(data, __func__))
+    if (is_pointer_null(index_array, __func__)
+        || is_index_arr_null(*index_array, __func__))
     {
         return;
     }
 
-    str->data = data;
+    PROFILE_FUNC(0);
+
+    mem_free((*index_array)->data, sizeof(size_t) * (*index_array)->capacity);
+    mem_free(*index_array, sizeof(dstr_index_arr_t));
+    *index_array = NULL;
 }
-*/
 
-size_t dstr_get_size(dstr_t *dstr)
+dstr_glob_t *dstr_glob_alloc(const char *pattern)
 {
-    if (is_dstr_null(dstr, __func__))
+    if (is_str_null(pattern, __func__))
     {
-        return 0;
+        return NULL;
     }
 
-    return dstr->size;
-}
+    PROFILE_FUNC(0);
 
-size_t dstr_get_capacity(dstr_t *dstr)
-{
-    if (is_dstr_null(dstr, __func__))
+    size_t pattern_size = strlen(pattern);
+    size_t num_of_stars = 0;
+
+    for (size_t i = 0; i < pattern_size; i++)
     {
-        return 0;
+        if (pattern[i] == '\\' && i + 1 < pattern_size)
+        {
+            i++;
+        }
+        else if (pattern[i] == '*')
+        {
+            num_of_stars++;
+        }
     }
 
-    return dstr->capacity;
-}
+    dstr_glob_t *glob = mem_alloc(sizeof(dstr_glob_t));
 
-char *dstr_get_literal(dstr_t *dstr)
-{
-    if (is_dstr_null(dstr, __func__))
+    glob->has_star = (num_of_stars > 0);
+    glob->min_size = 0;
+    glob->size = 0;
+    glob->segments = mem_alloc(sizeof(glob_segment_t) * (num_of_stars + 1));
+
+    size_t start = 0;
+
+    for (size_t i = 0; i <= pattern_size; i++)
     {
-        return NULL;
+        if (i + 1 < pattern_size && pattern[i] == '\\')
+        {
+            i++;
+            continue;
+        }
+        else if (i < pattern_size && pattern[i] != '*')
+        {
+            continue;
+        }
+
+        // Runs between "**" are empty and match right away.
+        setup_glob_segment(&glob->segments[glob->size], &pattern[start], i - start);
+        glob->min_size += glob->segments[glob->size].size;
+        glob->size++;
+
+        start = i + 1;
     }
 
-    return dstr->data;
+    return glob;
 }
 
-dstr_t *dstr_alloc(const char *data)
+bool dstr_glob_match(dstr_glob_t *glob, dstr_t *dstr)
 {
-    if (is_str_null(data, __func__))
+    if (is_glob_null(glob, __func__)
+        || is_dstr_null(dstr, __func__))
     {
-        return NULL;
+        return false;
     }
 
-    dstr_t *dstr = alloc_mem(sizeof(dstr_t));
+    PROFILE_FUNC(dstr->size);
 
-    dstr->size = strlen(data);
-    dstr->capacity = calculate_capacity(dstr->size);
-    dstr->data = alloc_mem(sizeof(char) * (dstr->capacity + 1));
-
-    memcpy(dstr->data, data, dstr->size + 1);
-
-    return dstr;
+    return is_glob_match(glob, dstr->data, dstr->size);
 }
 
-dstr_t *dstr_alloc_va(size_t size, ...)
+bool dstr_glob_match_str(dstr_glob_t *glob, const char *data)
 {
-    if (is_size_zero(size, __func__))
+    if (is_glob_null(glob, __func__)
+        || is_str_null(data, __func__))
     {
-        return NULL;
+        return false;
     }
 
-    va_list args;
-    va_start(args, size);
+    PROFILE_FUNC(0);
 
-    dstr_t *dstr = dstr_alloc(va_arg(args, char*));
+    return is_glob_match(glob, data, strlen(data));
+}
 
-    for (size_t i = 1; i < size; i++)
+size_t dstr_arr_filter_glob(dstr_arr_t *dstr_array, dstr_glob_t *glob, dstr_index_arr_t *index_array)
+{
+    if (is_dstr_arr_null(dstr_array, __func__)
+        || is_glob_null(glob, __func__)
+        || is_index_arr_null(index_array, __func__))
     {
-        dstr_append(dstr, va_arg(args, char*));
+        return 0;
     }
 
-    va_end(args);
+    PROFILE_FUNC(0);
 
-    return dstr;
-}
+    index_array->size = 0;
 
-void dstr_append(dstr_t *dstr, const char *data)
-{
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(data, __func__))
+    for (size_t i = 0; i < dstr_array->size; i++)
     {
-        return;
-    }
+        dstr_t *dstr = dstr_array->data_set[i];
 
-    size_t data_size = dstr_realloc_capacity(dstr, data);
+        if (is_glob_match(glob, dstr->data, dstr->size))
+        {
+            index_arr_push(index_array, i);
+        }
+    }
 
-    memcpy(&dstr->data[dstr->size - data_size], data, data_size + 1);
+    return index_array->size;
 }
 
-void dstr_append_va(dstr_t *dstr, size_t size, ...)
+void dstr_glob_free(dstr_glob_t **glob)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_size_zero(size, __func__))
+    if (is_pointer_null(glob, __func__)
+        || is_glob_null(*glob, __func__))
     {
         return;
     }
 
-    va_list args;
-    va_start(args, size);
+    PROFILE_FUNC(0);
 
-    for (size_t i = 0; i < size; i++)
+    for (size_t i = 0; i < (*glob)->size; i++)
     {
-        dstr_append(dstr, va_arg(args, char*));
+        glob_segment_t *segment = &(*glob)->segments[i];
+
+        mem_free(segment->data, sizeof(char) * (segment->size + 1));
+        mem_free(segment->is_any, sizeof(bool) * (segment->size + 1));
     }
 
-    va_end(args);
+    mem_free((*glob)->segments, sizeof(glob_segment_t) * (*glob)->size);
+    mem_free(*glob, sizeof(dstr_glob_t));
+    *glob = NULL;
 }
 
-dstr_t *dstr_add(dstr_t *curr_dstr, dstr_t *newest_dstr)
+dstr_intern_t *dstr_intern_alloc(void)
 {
-    return dstr_add_va(2, curr_dstr, newest_dstr);
+    PROFILE_FUNC(0);
+
+    dstr_intern_t *intern = mem_alloc(sizeof(dstr_intern_t));
+
+    intern->size = 0;
+    intern->capacity = DEFAULT_CAPACITY;
+    intern->slots = mem_alloc(sizeof(intern_slot_t) * intern->capacity);
+    memset(intern->slots, 0, sizeof(intern_slot_t) * intern->capacity);
+
+    return intern;
 }
 
-dstr_t *dstr_add_va(size_t size, ...)
+dstr_t *dstr_intern(dstr_intern_t *intern, const char *data)
 {
-    if (is_size_zero(size, __func__))
+    if (is_intern_null(intern, __func__)
+        || is_str_null(data, __func__))
     {
         return NULL;
     }
 
-    va_list args;
-    va_start(args, size);
+    PROFILE_FUNC(0);
 
-    dstr_t *temp_dstr = NULL;
-    dstr_t *total_dstr = dstr_alloc_copy(va_arg(args, dstr_t*));
+    size_t size = strlen(data);
 
-    for (size_t i = 1; i < size; i++)
+    return intern_bytes(intern, data, size, hash_bytes(data, size));
+}
+
+dstr_t *dstr_intern_dstr(dstr_intern_t *intern, dstr_t *dstr)
+{
+    if (is_intern_null(intern, __func__)
+        || is_dstr_null(dstr, __func__))
     {
-        temp_dstr = va_arg(args, dstr_t*);
+        return NULL;
+    }
 
-        if (temp_dstr == NULL)
-        {
-            va_end(args);
-            return total_dstr;
-        }
+    PROFILE_FUNC(dstr->size);
 
-        dstr_append(total_dstr, temp_dstr->data);
+    return intern_bytes(intern, dstr->data, dstr->size, get_dstr_hash(dstr));
+}
+
+dstr_t *dstr_intern_find(dstr_intern_t *intern, const char *data)
+{
+    if (is_intern_null(intern, __func__)
+        || is_str_null(data, __func__))
+    {
+        return NULL;
     }
 
-    va_end(args);
+    PROFILE_FUNC(0);
 
-    return total_dstr;
+    size_t size = strlen(data);
+
+    return find_intern_slot(intern, data, size, hash_bytes(data, size))->dstr;
 }
 
-void dstr_add_equals(dstr_t *curr_dstr, dstr_t *newest_dstr)
+size_t dstr_intern_get_size(dstr_intern_t *intern)
 {
-    dstr_add_equals_va(curr_dstr, 1, newest_dstr);
+    if (is_intern_null(intern, __func__))
+    {
+        return 0;
+    }
+
+    return intern->size;
 }
 
-void dstr_add_equals_va(dstr_t *dstr, size_t size, ...)
+void dstr_intern_free(dstr_intern_t **intern)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_size_zero(size, __func__))
+    if (is_pointer_null(intern, __func__)
+        || is_intern_null(*intern, __func__))
     {
         return;
     }
 
-    va_list args;
-    va_start(args, size);
-
-    dstr_t *temp_dstr = NULL;
+    PROFILE_FUNC(0);
 
-    for (size_t i = 0; i < size; i++)
+    for (size_t i = 0; i < (*intern)->capacity; i++)
     {
-        temp_dstr = va_arg(args, dstr_t*);
-
-        if (temp_dstr == NULL)
+        if ((*intern)->slots[i].dstr != NULL)
         {
-            va_end(args);
-            return;
+            dstr_free(&(*intern)->slots[i].dstr);
         }
-
-        dstr_append(dstr, temp_dstr->data);
     }
 
-    va_end(args);
+    mem_free((*intern)->slots, sizeof(intern_slot_t) * (*intern)->capacity);
+    mem_free(*intern, sizeof(dstr_intern_t));
+    *intern = NULL;
 }
 
-void dstr_before(dstr_t *dstr, const char *data)
+dstr_map_t *dstr_map_alloc(size_t size)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(data, __func__))
-    {
-        return;
-    }
+    PROFILE_FUNC(0);
 
-    size_t data_size = dstr_realloc_capacity(dstr, data);
+    dstr_map_t *map = mem_alloc(sizeof(dstr_map_t));
 
-    memcpy(&dstr->data[data_size], dstr->data, dstr->size+1);
-    memcpy(dstr->data, data, data_size);
+    map->size = 0;
+    setup_map_slots(map, get_map_capacity(size));
+
+    return map;
 }
 
-dstr_t *dstr_alloc_substr(const char *data, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt)
+dstr_map_t *dstr_map_alloc_arr(dstr_arr_t *dstr_array, void **values)
 {
-    if (is_not_valid_str(data, __func__))
+    if (is_dstr_arr_null(dstr_array, __func__))
     {
         return NULL;
     }
 
-    return alloc_substr(data, strlen(data), start_opt, end_opt, step_opt, __func__);
-}
+    PROFILE_FUNC(0);
 
-dstr_t *dstr_alloc_subdstr(dstr_t *dstr, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt)
-{
-    if (is_dstr_null(dstr, __func__))
+    dstr_map_t *map = dstr_map_alloc(dstr_array->size);
+
+    for (size_t i = 0; i < dstr_array->size; i++)
     {
-        return NULL;
+        dstr_t *key = dstr_array->data_set[i];
+
+        set_map_value(map, key->data, key->size, get_dstr_hash(key), (values != NULL) ? values[i] : NULL);
     }
 
-    return alloc_substr(dstr->data, dstr->size, start_opt, end_opt, step_opt, __func__);
+    return map;
 }
 
-bool dstr_is_substr(const char *big, const char *little)
+void dstr_map_reserve(dstr_map_t *map, size_t size)
 {
-    if (big == NULL || little == NULL)
+    if (is_map_null(map, __func__))
     {
-        return false;
+        return;
     }
 
-    char *result = strstr(big, little);
+    PROFILE_FUNC(0);
 
-    if (!(result))
+    size_t capacity = get_map_capacity(size);
+
+    if (capacity > map->capacity)
     {
-        return false;
+        rehash_map(map, capacity);
     }
-
-    return !(strncmp(little, result, strlen(little)));
 }
 
-bool dstr_is_subdstr(dstr_t *big, dstr_t *little)
+bool dstr_map_set(dstr_map_t *map, const char *key, void *value)
 {
-    return dstr_is_substr(big->data, little->data);
+    if (is_map_null(map, __func__)
+        || is_str_null(key, __func__))
+    {
+        return false;
+    }
+
+    PROFILE_FUNC(0);
+
+    size_t size = strlen(key);
+
+    return set_map_value(map, key, size, hash_bytes(key, size), value);
 }
 
-void dstr_replace(dstr_t *dstr, const char *old_str, const char *new_str)
+bool dstr_map_set_dstr(dstr_map_t *map, dstr_t *key, void *value)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_str_null(old_str, __func__)
-        || is_str_null(new_str, __func__))
+    if (is_map_null(map, __func__)
+        || is_dstr_null(key, __func__))
     {
-        return;
+        return false;
     }
 
-    dstr_replace_count(dstr, old_str, new_str, 0);
+    PROFILE_FUNC(0);
+
+    return set_map_value(map, key->data, key->size, get_dstr_hash(key), value);
 }
 
-void dstr_replace_count(dstr_t *dstr, const char *old_str, const char *new_str, size_t count)
+void *dstr_map_get(dstr_map_t *map, const char *key)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_str_null(old_str, __func__)
-        || is_str_null(new_str, __func__))
+    if (is_map_null(map, __func__)
+        || is_str_null(key, __func__))
     {
-        return;
+        return NULL;
     }
 
-    size_t num_of_occurrences = count_occurrences_in_str(dstr->data, old_str, count, 0, dstr->size);
+    return dstr_map_get_bytes(map, key, strlen(key));
+}
 
-    if (num_of_occurrences == 0)
+void *dstr_map_get_dstr(dstr_map_t *map, dstr_t *key)
+{
+    if (is_map_null(map, __func__)
+        || is_dstr_null(key, __func__))
     {
-        printf("%s: %swarning:%s could not find substring%s\n", __func__, PURPLE, WHITE, RESET);
-        return;
+        return NULL;
     }
 
-    size_t i = 0;
-    size_t num_of_replacements = 0;
-    size_t old_str_size = strlen(old_str);
-    size_t new_str_size = strlen(new_str);
-    size_t total_size = ((dstr->size - (old_str_size  * num_of_occurrences)) + (new_str_size * num_of_occurrences));
+    PROFILE_FUNC(0);
 
-    size_t capacity = calculate_capacity(total_size);
+    map_slot_t *slot = find_map_slot(map, key->data, key->size, get_dstr_hash(key));
 
-    char *copy = dstr->data;
-    char *replacement = alloc_mem(sizeof(char) * (capacity + 1));
+    return (slot != NULL) ? slot->value : NULL;
+}
 
-    while (*copy != '\0')
+void *dstr_map_get_bytes(dstr_map_t *map, const char *key, size_t size)
+{
+    if (is_map_null(map, __func__)
+        || is_str_null(key, __func__))
     {
-        if (num_of_replacements < num_of_occurrences && strstr(copy, old_str) == copy)
-        {
-            memcpy(&replacement[i], new_str, new_str_size);
-            num_of_replacements++;
-            i += new_str_size;
-            copy += old_str_size;
-        }
-        else
-        {
-            replacement[i++] = *copy++;
-        }
+        return NULL;
     }
 
-    replacement[i] = '\0';
+    PROFILE_FUNC(0);
 
-    dstr_data_free(dstr);
+    map_slot_t *slot = find_map_slot(map, key, size, hash_bytes(key, size));
 
-    dstr->size = total_size;
-    dstr->capacity = capacity;
-    dstr->data = replacement;
+    return (slot != NULL) ? slot->value : NULL;
 }
 
-void dstr_erase(dstr_t *dstr, const char *data)
+bool dstr_map_contains(dstr_map_t *map, const char *key)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_str_null(data, __func__))
+    if (is_map_null(map, __func__)
+        || is_str_null(key, __func__))
     {
-        return;
+        return false;
     }
 
-    dstr_replace_count(dstr, data, "", 0);
+    PROFILE_FUNC(0);
+
+    size_t size = strlen(key);
+
+    return (find_map_slot(map, key, size, hash_bytes(key, size)) != NULL);
 }
 
-void str_erase_count(dstr_t *dstr, const char *data, size_t count)
+bool dstr_map_contains_dstr(dstr_map_t *map, dstr_t *key)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_str_null(data, __func__))
+    if (is_map_null(map, __func__)
+        || is_dstr_null(key, __func__))
     {
-        return;
+        return false;
     }
 
-    dstr_replace_count(dstr, data, "", count);
+    PROFILE_FUNC(0);
+
+    return (find_map_slot(map, key->data, key->size, get_dstr_hash(key)) != NULL);
 }
 
-void dstr_erase_index(dstr_t *dstr, int64_t start, int64_t end)
+bool dstr_map_erase(dstr_map_t *map, const char *key)
 {
-    if (is_dstr_null(dstr, __func__)
-        || check_ranges(&start, &end, dstr->size, __func__))
+    if (is_map_null(map, __func__)
+        || is_str_null(key, __func__))
     {
-        return;
+        return false;
     }
 
-    size_t conjoin_data_size = dstr->size - (size_t)(end - start);
-    size_t capacity = calculate_capacity(conjoin_data_size);
-    char *conjoin_data = alloc_mem(sizeof(char) * (capacity + 1));
-
-    memcpy(conjoin_data, dstr->data, start);
-    memcpy(&conjoin_data[start], &dstr->data[end], (conjoin_data_size - (size_t)start));
-    conjoin_data[conjoin_data_size] = '\0';
+    PROFILE_FUNC(0);
 
-    dstr_data_free(dstr);
+    size_t size = strlen(key);
 
-    dstr->data = conjoin_data;
-    dstr->size = conjoin_data_size;
-    dstr->capacity = capacity;
+    return erase_map_key(map, key, size, hash_bytes(key, size));
 }
 
-size_t dstr_find(dstr_t *dstr, const char *search_val)
+bool dstr_map_erase_dstr(dstr_map_t *map, dstr_t *key)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(search_val, __func__))
+    if (is_map_null(map, __func__)
+        || is_dstr_null(key, __func__))
     {
-        return 0;
+        return false;
     }
 
-    char *found = strstr(dstr->data, search_val);
-
-    if (found == NULL)
-    {
-        printf("%s: %swarning:%s could not find the searched string%s\n", __func__, PURPLE, WHITE, RESET);
-        return 0;
-    }
+    PROFILE_FUNC(0);
 
-    return (size_t)(found - dstr->data);
+    return erase_map_key(map, key->data, key->size, get_dstr_hash(key));
 }
 
-size_t dstr_count(dstr_t *dstr, const char *search_val, int64_t start, int64_t end)
+size_t dstr_map_get_size(dstr_map_t *map)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(search_val, __func__) 
-        || check_ranges(&start, &end, dstr->size, __func__))
+    if (is_map_null(map, __func__))
     {
         return 0;
     }
 
-    return count_occurrences_in_str(dstr->data, search_val, 0, (size_t)start, (size_t)end);
+    return map->size;
 }
 
-void dstr_lstrip(dstr_t *dstr, const char *characters)
+bool dstr_map_next(dstr_map_t *map, size_t *iterator, dstr_t **key, void **value)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(characters, __func__))
+    if (is_map_null(map, __func__)
+        || is_pointer_null(iterator, __func__))
     {
-        return;
+        return false;
     }
 
-    char *copy = dstr->data;
-
-    while (strchr(characters, *copy))
+    while (*iterator < map->capacity && map->control[*iterator] < 0)
     {
-        copy++;
+        (*iterator)++;
     }
 
-    if (copy == dstr->data)
+    if (*iterator == map->capacity)
     {
-        return;
+        return false;
     }
-    else if (*copy != '\0')
-    {
-        size_t striped_size = dstr->size - (size_t)(copy - dstr->data);
-        size_t capacity = calculate_capacity(striped_size);
-        char *striped = alloc_mem(sizeof(char) * (capacity + 1));
-
-        memcpy(striped, copy, striped_size + 1);
-        dstr_data_free(dstr);
 
-        dstr->data = striped;
-        dstr->size = striped_size;
-        dstr->capacity = capacity;
+    if (key != NULL)
+    {
+        *key = map->slots[*iterator].key;
     }
-    else
+
+    if (value != NULL)
     {
-        dstr_data_free(dstr);
-        set_empty_dstr(dstr);
+        *value = map->slots[*iterator].value;
     }
+
+    (*iterator)++;
+
+    return true;
 }
 
-void dstr_rstrip(dstr_t *dstr, const char *characters)
+void dstr_map_free(dstr_map_t **map)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(characters, __func__))
+    if (is_pointer_null(map, __func__)
+        || is_map_null(*map, __func__))
     {
         return;
     }
 
-    char *forward = dstr->data + dstr->size;
+    PROFILE_FUNC(0);
 
-    while (strchr(characters, (*(forward-1))))
+    for (size_t i = 0; i < (*map)->capacity; i++)
     {
-        forward--;
+        if ((*map)->control[i] >= 0)
+        {
+            dstr_free(&(*map)->slots[i].key);
+        }
     }
 
-    if (forward == (dstr->data + dstr->size))
+    mem_free((*map)->control, sizeof(int8_t) * (*map)->capacity);
+    mem_free((*map)->slots, sizeof(map_slot_t) * (*map)->capacity);
+    mem_free(*map, sizeof(dstr_map_t));
+    *map = NULL;
+}
+
+dstr_snapshot_t *dstr_arr_open_snapshot(const char *path)
+{
+    if (is_not_valid_str(path, __func__))
     {
-        return;
+        return NULL;
     }
-    else if (forward != dstr->data)
-    {
-        size_t striped_size = (size_t)(forward - dstr->data);
-        size_t capacity = calculate_capacity(striped_size);
-        char *striped = alloc_mem(sizeof(char) * (capacity + 1));
 
-        memcpy(striped, dstr->data, striped_size);
-        dstr_data_free(dstr);
-        striped[striped_size] = '\0';
+    PROFILE_FUNC(0);
 
-        dstr->data = striped;
-        dstr->size = striped_size;
-        dstr->capacity = capacity;
-    }
-    else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat file_stat;
+    char *map = MAP_FAILED;
+    size_t map_size = 0;
+
+    if (fd != -1 && fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
     {
-        dstr_data_free(dstr);
-        set_empty_dstr(dstr);
+        map_size = (size_t)file_stat.st_size;
+        map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
     }
-}
 
-void dstr_strip(dstr_t *dstr)
-{
-    if (is_dstr_null(dstr, __func__))
+    if (fd != -1)
     {
-        return;
+        close(fd);
     }
 
-    dstr_lstrip(dstr, "\n ");
-    dstr_rstrip(dstr, "\n ");
-}
-
-void dstr_strip_chars(dstr_t *dstr, const char *characters)
-{
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(characters, __func__))
+    if (map == MAP_FAILED)
     {
-        return;
+        printf("%s: %swarning:%s failed to open snapshot%s\n", __func__, PURPLE, WHITE, RESET);
+        return NULL;
     }
 
-    dstr_lstrip(dstr, characters);
-    dstr_rstrip(dstr, characters);
-}
-
-char dstr_char_at(dstr_t *dstr, int64_t index)
-{
-    if (is_dstr_null(dstr, __func__)
-        ||check_index(&index, dstr->size, __func__))
+    if (!is_valid_snapshot_header(map, map_size))
     {
-        return '\0';
+        printf("%s: %swarning:%s snapshot is corrupt or from another version%s\n", __func__, PURPLE, WHITE, RESET);
+        munmap(map, map_size);
+        return NULL;
     }
 
-    return dstr->data[index];
+    dstr_snapshot_t *snapshot = mem_alloc(sizeof(dstr_snapshot_t));
+    snapshot_header_t header;
+
+    memcpy(&header, map, sizeof(snapshot_header_t));
+    snapshot->map = map;
+    snapshot->map_size = map_size;
+    snapshot->size = (size_t)header.num_of_elements;
+    snapshot->blob_size = (size_t)header.blob_size;
+    snapshot->checksum = header.checksum;
+    snapshot->offsets = (const uint64_t*)(map + sizeof(snapshot_header_t));
+    snapshot->blob = (const char*)(snapshot->offsets + snapshot->size + 1);
+
+    return snapshot;
 }
 
-void dstr_upper(dstr_t *dstr)
+size_t dstr_snapshot_get_size(dstr_snapshot_t *snapshot)
 {
-    if (is_dstr_null(dstr, __func__))
+    if (is_snapshot_null(snapshot, __func__))
     {
-        return;
+        return 0;
     }
 
-    size_t i = 0;
-
-    while (dstr->data[i] != '\0')
-    {
-        dstr->data[i] = (char)toupper(dstr->data[i]);
-        i++;
-    }
+    return snapshot->size;
 }
 
-void dstr_lower(dstr_t *dstr)
+dstr_view_t dstr_snapshot_get_view(dstr_snapshot_t *snapshot, int64_t index)
 {
-    if (is_dstr_null(dstr, __func__))
+    if (is_snapshot_null(snapshot, __func__)
+        || check_index(&index, snapshot->size, __func__))
     {
-        return;
+        return (dstr_view_t){NULL, 0};
     }
-
-    size_t i = 0;
-
-    while (dstr->data[i] != '\0')
+    else if (!is_valid_snapshot_element(snapshot, (size_t)index))
     {
-        dstr->data[i] = (char)tolower(dstr->data[i]);
-        i++;
+        printf("%s: %swarning:%s snapshot element is corrupt%s\n", __func__, PURPLE, WHITE, RESET);
+        return (dstr_view_t){NULL, 0};
     }
+
+    uint64_t offset = snapshot->offsets[index];
+
+    return (dstr_view_t){&snapshot->blob[offset], (size_t)(snapshot->offsets[index + 1] - offset - 1)};
 }
 
-void dstr_swapcase(dstr_t *dstr)
+dstr_arr_t *dstr_snapshot_alloc_arr(dstr_snapshot_t *snapshot)
 {
-    if (is_dstr_null(dstr, __func__))
+    if (is_snapshot_null(snapshot, __func__))
     {
-        return;
+        return NULL;
     }
 
-    size_t i = 0;
+    PROFILE_FUNC(0);
 
-    while (dstr->data[i] != '\0')
+    for (size_t i = 0; i < snapshot->size; i++)
     {
-        dstr->data[i] = isupper(dstr->data[i]) ? (char)tolower(dstr->data[i]) : (char)toupper(dstr->data[i]);
-        i++;
+        if (!is_valid_snapshot_element(snapshot, i))
+        {
+            printf("%s: %swarning:%s snapshot element is corrupt%s\n", __func__, PURPLE, WHITE, RESET);
+            return NULL;
+        }
     }
-}
 
-void dstr_capitalize(dstr_t *dstr)
-{  
-    if (is_dstr_null(dstr, __func__))
+    dstr_arr_t *dstr_array = alloc_sized_dstr_arr(snapshot->size);
+
+    for (size_t i = 0; i < snapshot->size; i++)
     {
-        return;
+        uint64_t offset = snapshot->offsets[i];
+        dstr_array->data_set[i] = alloc_sized_dstr(&snapshot->blob[offset], (size_t)(snapshot->offsets[i + 1] - offset - 1));
     }
 
-    dstr->data[0] = (char)toupper(dstr->data[0]);
+    return dstr_array;
 }
 
-void dstr_title(dstr_t *dstr)
+// Reads the whole file, so it costs as much as reading it.
+bool dstr_snapshot_verify(dstr_snapshot_t *snapshot)
 {
-    if (is_dstr_null(dstr, __func__))
+    if (is_snapshot_null(snapshot, __func__))
     {
-        return;
+        return false;
     }
 
-    dstr_capitalize(dstr);
+    PROFILE_FUNC(snapshot->map_size);
 
-    for (size_t i = (dstr->size-1); i > 0; i--)
+    size_t table_size = (snapshot->size + 1) * sizeof(uint64_t);
+
+    if (update_crc32c(0, (const char*)snapshot->offsets, table_size + snapshot->blob_size) != snapshot->checksum)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < snapshot->size; i++)
     {
-        if (!(isalpha(dstr->data[i-1])))
+        if (!is_valid_snapshot_element(snapshot, i))
         {
-            dstr->data[i] = (char)toupper(dstr->data[i]);
+            return false;
         }
     }
+
+    return true;
 }
 
-dstr_t *dstr_alloc_prompt(const char *output_message)
+void dstr_snapshot_free(dstr_snapshot_t **snapshot)
 {
-    if (is_str_null(output_message, __func__))
+    if (is_pointer_null(snapshot, __func__)
+        || is_snapshot_null(*snapshot, __func__))
     {
-        return NULL;
+        return;
     }
 
-    char input[STR_MAX_CHARS] = {0};
-    dstr_t *dstr = alloc_mem(sizeof(dstr_t));
+    PROFILE_FUNC(0);
 
-    prompt_getline(output_message, input, STR_MAX_CHARS);
-
-    dstr->size = strlen(input);
-    dstr->capacity = calculate_capacity(dstr->size);
-    dstr->data = alloc_mem(sizeof(char) * (dstr->capacity + 1));
-
-    memcpy(dstr->data, input, dstr->size + 1);
-
-    return dstr;
+    munmap((*snapshot)->map, (*snapshot)->map_size);
+    mem_free(*snapshot, sizeof(dstr_snapshot_t));
+    *snapshot = NULL;
 }
 
-dstr_t *dstr_alloc_read_file(const char *path, const char *mode)
+// Like Python's str.maketrans, from[i] becomes to[i], and the chars in
+// deleted are removed. A later pair for the same char wins, and deleting
+// wins over mapping. deleted may be NULL.
+dstr_trans_t *dstr_maketrans(const char *from, const char *to, const char *deleted)
 {
-    if (is_not_valid_str(path, __func__)
-        || is_not_valid_str(mode, __func__))
+    if (is_str_null(from, __func__)
+        || is_str_null(to, __func__))
     {
         return NULL;
     }
 
-    if (strstr(mode, "w") != NULL || strstr(mode, "a") != NULL)
+    size_t size = strlen(from);
+
+    if (size != strlen(to))
     {
-        printf("%s: %swarning:%s file can not be written%s\n", __func__, PURPLE, WHITE, RESET);
+        printf("%s: %swarning:%s from and to must be the same length%s\n", __func__, PURPLE, WHITE, RESET);
         return NULL;
     }
 
-    FILE *fp = fopen(path, mode);
-    dstr_t *dstr = NULL;
+    PROFILE_FUNC(size);
 
-    if (strstr(mode, "b"))
+    dstr_trans_t *trans = mem_alloc(sizeof(dstr_trans_t));
+
+    for (size_t i = 0; i < 256; i++)
     {
-        fseek(fp, 0, SEEK_END);
-        size_t file_size = (size_t)ftell(fp);
-        fseek(fp, 0, SEEK_SET);
-    
-        dstr = alloc_setup_capacity(file_size);
+        trans->map[i] = (unsigned char)i;
+        trans->is_deleted[i] = false;
+    }
 
-        fread(dstr->data, dstr->size + 1, 1, fp);
+    for (size_t i = 0; i < size; i++)
+    {
+        trans->map[(unsigned char)from[i]] = (unsigned char)to[i];
     }
-    else
+
+    for (; deleted != NULL && *deleted != '\0'; deleted++)
     {
-        dstr = alloc_read_file_content(fp);
+        trans->is_deleted[(unsigned char)*deleted] = true;
     }
 
-    fclose(fp);
+    trans->num_of_pairs = 0;
+    trans->num_of_deleted = 0;
+    setup_trans_bytes(trans);
 
-    return dstr;
+    return trans;
 }
 
-void str_write_file(dstr_t *dstr, const char *path, const char *mode)
+void dstr_translate(dstr_t *dstr, dstr_trans_t *trans)
 {
     if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(path, __func__)
-        || is_not_valid_str(mode, __func__))
+        || is_trans_null(trans, __func__))
     {
         return;
     }
 
-    if (strstr(mode, "r") != NULL || strstr(mode, "+") != NULL)
+    PROFILE_FUNC(dstr->size);
+
+    invalidate_cached(dstr);
+
+    size_t size = translate_str(trans, dstr->data, dstr->size);
+
+    dstr->data[size] = '\0';
+    set_dstr_size(dstr, size);
+}
+
+// Escapes for the inside of a JSON string, the quotes aren't added.
+void dstr_escape_json(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
     {
-        printf("%s: %swarning:%s file can not be read%s\n", __func__, PURPLE, WHITE, RESET);
         return;
     }
 
-    FILE *fp = fopen(path, mode);
+    PROFILE_FUNC(dstr->size);
 
-    if (fp == NULL) 
+    escape_dstr(dstr, ESCAPE_JSON);
+}
+
+// Returns false and leaves the dstr as it was if an escape isn't valid JSON.
+bool dstr_unescape_json(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
     {
-        printf("%s: %swarning:%s failed to write content%s\n", __func__, PURPLE, WHITE, RESET);
-        return;
+        return false;
     }
 
-    if (strstr(mode, "b"))
+    PROFILE_FUNC(dstr->size);
+
+    if (!unescape_dstr(dstr, ESCAPE_JSON))
     {
-        fwrite(dstr->data, dstr->size + 1, 1, fp);
+        printf("%s: %swarning:%s invalid escape%s\n", __func__, PURPLE, WHITE, RESET);
+        return false;
     }
-    else
+
+    return true;
+}
+
+// Escapes for the inside of a C string literal, bytes from 0x80 up are kept as they are.
+void dstr_escape_c(dstr_t *dstr)
+{
+    if (is_dstr_null(dstr, __func__))
     {
-        fprintf(fp, "%s", dstr->data);
+        return;
     }
 
-    fclose(fp);
+    PROFILE_FUNC(dstr->size);
+
+    escape_dstr(dstr, ESCAPE_C);
 }
 
-dstr_t *dstr_alloc_sys_output(const char *cmd)
+bool dstr_unescape_c(dstr_t *dstr)
 {
-    if (is_not_valid_str(cmd, __func__))
+    if (is_dstr_null(dstr, __func__))
     {
-        return NULL;
+        return false;
     }
 
-    FILE *fp = popen(cmd, "r");
-    dstr_t *dstr = alloc_read_file_content(fp);
-    fclose(fp);
+    PROFILE_FUNC(dstr->size);
 
-    return dstr;
+    if (!unescape_dstr(dstr, ESCAPE_C))
+    {
+        printf("%s: %swarning:%s invalid escape%s\n", __func__, PURPLE, WHITE, RESET);
+        return false;
+    }
+
+    return true;
 }
 
-size_t dstr_ascii_total(dstr_t *dstr)
+// Wraps the dstr in single quotes for a POSIX shell, with ' written as '\''.
+void dstr_quote_shell(dstr_t *dstr)
 {
     if (is_dstr_null(dstr, __func__))
     {
-        return 0;
+        return;
+    }
+
+    PROFILE_FUNC(dstr->size);
+
+    escape_dstr(dstr, ESCAPE_SHELL);
+}
+
+void dstr_append_base64(dstr_t *dstr, const char *data, size_t size, bool is_url)
+{
+    if (is_dstr_null(dstr, __func__)
+        || (size > 0 && is_str_null(data, __func__)))
+    {
+        return;
     }
 
-    return str_ascii_total(dstr->data);
+    PROFILE_FUNC(size);
+
+    size_t encoded_size = get_base64_size(size, is_url);
+
+    invalidate_cached(dstr);
+    reserve_dstr_data(dstr, dstr->size + encoded_size);
+    encode_base64(data, size, &dstr->data[dstr->size], is_url);
+    set_dstr_size(dstr, dstr->size + encoded_size);
+    dstr->data[dstr->size] = '\0';
 }
 
-int64_t dstr_ll(dstr_t *dstr)
+bool dstr_decode_base64(dstr_t *dstr, const char *data, size_t size, bool is_url)
 {
-    if (is_dstr_null(dstr, __func__))
+    if (is_dstr_null(dstr, __func__)
+        || (size > 0 && is_str_null(data, __func__)))
     {
-        return 0;
+        return false;
     }
 
-    return strtoll(dstr->data, NULL, 10);
-}
+    PROFILE_FUNC(size);
 
-double dstr_double(dstr_t *dstr)
-{
-    if (is_dstr_null(dstr, __func__))
+    size_t decoded_size = get_decoded_base64_size(data, &size, is_url);
+
+    if (decoded_size != SIZE_MAX)
     {
-        return 0.0;
+        reserve_dstr_data(dstr, dstr->size + decoded_size);
+
+        if (decode_base64(data, size, &dstr->data[dstr->size], is_url))
+        {
+            invalidate_cached(dstr);
+            set_dstr_size(dstr, dstr->size + decoded_size);
+            dstr->data[dstr->size] = '\0';
+            return true;
+        }
     }
 
-    return strtod(dstr->data, NULL);
+    dstr->data[dstr->size] = '\0';
+    printf("%s: %swarning:%s invalid base64%s\n", __func__, PURPLE, WHITE, RESET);
+
+    return false;
 }
 
-dstr_t *dstr_alloc_ll_to_dstr(int64_t number)
+void dstr_append_hex(dstr_t *dstr, const char *data, size_t size)
 {
-    dstr_t *digits = dstr_alloc("");
-
-    while (number > 0)
+    if (is_dstr_null(dstr, __func__)
+        || (size > 0 && is_str_null(data, __func__)))
     {
-        dstr_before(digits, get_str_number((number % 10)));
-        number /= 10;
+        return;
     }
 
-    return digits;
+    PROFILE_FUNC(size);
+
+    invalidate_cached(dstr);
+    reserve_dstr_data(dstr, dstr->size + size * 2);
+    encode_hex(data, size, &dstr->data[dstr->size]);
+    set_dstr_size(dstr, dstr->size + size * 2);
+    dstr->data[dstr->size] = '\0';
 }
 
-dstr_t *dstr_alloc_ll_to_binary_dstr(int64_t number, size_t bits_shown)
+bool dstr_decode_hex(dstr_t *dstr, const char *data, size_t size)
 {
-    dstr_t *bi_num = dstr_alloc("");
-
-    while (number > 0)
+    if (is_dstr_null(dstr, __func__)
+        || (size > 0 && is_str_null(data, __func__)))
     {
-        dstr_before(bi_num, get_str_number(number % 2));
-        number /= 2;
+        return false;
     }
 
-    if (bits_shown > bi_num->size)
+    PROFILE_FUNC(size);
+
+    if (size % 2 == 0)
     {
-        bits_shown -= bi_num->size;
+        reserve_dstr_data(dstr, dstr->size + size / 2);
 
-        for (size_t i = 0; i < bits_shown; i++)
+        if (decode_hex(data, size, &dstr->data[dstr->size]))
         {
-            dstr_before(bi_num, "0");
+            invalidate_cached(dstr);
+            set_dstr_size(dstr, dstr->size + size / 2);
+            dstr->data[dstr->size] = '\0';
+            return true;
         }
     }
 
-    return bi_num;
+    dstr->data[dstr->size] = '\0';
+    printf("%s: %swarning:%s invalid hex%s\n", __func__, PURPLE, WHITE, RESET);
+
+    return false;
 }
 
-dstr_t *dstr_alloc_str_to_binary_dstr(const char *number, size_t bits_shown)
+// Reads CSV from memory that has to outlive the reader, like a mapped file.
+dstr_csv_reader_t *dstr_csv_reader_alloc(const char *data, size_t size, char delimiter)
 {
-    if (is_not_valid_str(number, __func__))
+    if (size > 0 && is_str_null(data, __func__))
     {
         return NULL;
     }
 
-    return dstr_alloc_ll_to_binary_dstr(strtoll(number, NULL, 10), bits_shown);
-}
+    PROFILE_FUNC(size);
 
-dstr_t *dstr_alloc_dstr_to_binary_dstr(dstr_t *dstr, size_t bits_shown)
-{
-    if (is_dstr_null(dstr, __func__))
+    dstr_csv_reader_t *reader = alloc_csv_reader(delimiter, __func__);
+
+    if (reader != NULL)
     {
-        return NULL;
+        reader->data = data;
+        reader->size = size;
     }
 
-    return dstr_alloc_ll_to_binary_dstr(dstr_ll(dstr), bits_shown);
+    return reader;
 }
 
-dstr_t *dstr_alloc_copy(dstr_t *dstr)
+dstr_csv_reader_t *dstr_csv_reader_alloc_stream(FILE *fp, char delimiter)
 {
-    if (is_dstr_null(dstr, __func__))
+    if (is_pointer_null(fp, __func__))
     {
         return NULL;
     }
 
-    return dstr_alloc(dstr->data);
-}
+    PROFILE_FUNC(0);
 
-void dstr_print(dstr_t *dstr, const char *beginning, const char *end)
-{
-    if (is_dstr_null(dstr, __func__)
-        || is_str_null(beginning, __func__)
-        || is_str_null(end, __func__))
+    dstr_csv_reader_t *reader = alloc_csv_reader(delimiter, __func__);
+
+    if (reader != NULL)
     {
-        return;
+        reader->fp = fp;
+        reader->is_eof = false;
+        reader->buffer = alloc_dstr();
+        alloc_dstr_capacity(reader->buffer, CSV_BUFFER_SIZE);
+        set_dstr_size(reader->buffer, 0);
+        reader->data = reader->buffer->data;
     }
 
-    printf("%s%s%s", beginning, dstr->data, end);
+    return reader;
 }
 
-void dstr_free(dstr_t **dstr)
+bool dstr_csv_reader_next(dstr_csv_reader_t *reader)
 {
-    if (is_pointer_null(dstr, __func__)
-        || is_dstr_null(*dstr, __func__))
+    if (is_csv_reader_null(reader, __func__))
     {
-        return;
+        return false;
     }
 
-    dstr_data_free(*dstr);
-    free_mem(*dstr, sizeof(dstr_t));
-    *dstr = NULL;
-}
-
+    PROFILE_FUNC(0);
 
-/*
-void sa_set_size(dstr_arr_t *dstr_array, int64_t size)
-{
-    if (str_array == NULL)
+    while (true)
     {
-        printf("%s: %swarning:%s string_array is NULL%s\n", __func__, PURPLE, WHITE, RESET);
-        return;
-    }
+        if (reader->position < reader->size && find_csv_record(reader))
+        {
+            setup_csv_fields(reader);
+            return true;
+        }
+        else if (reader->is_eof)
+        {
+            reader->num_of_fields = 0;
+            return false;
+        }
 
-    str_array->size = size;
+        refill_csv_reader(reader);
+    }
 }
 
-void sa_set_index(dstr_arr_t d*str_array, int64_t index, dstr_t *dstr)
+size_t dstr_csv_reader_get_num_of_fields(dstr_csv_reader_t *reader)
 {
-    if (check_index(&index, str_array->size, __func__))
-    {
-        return;
-    }
-    else if (str_array == NULL)
+    if (is_csv_reader_null(reader, __func__))
     {
-        printf("%s: %swarning:%s string_array is NULL%s\n", __func__, PURPLE, WHITE, RESET);
-        return;
+        return 0;
     }
 
-    str_array->data_set[index] = str;
+    return reader->num_of_fields;
 }
-*/
 
-void dstr_arr_set_dstr(dstr_arr_t *dstr_array, int64_t index, dstr_t *dstr_input)
+dstr_view_t dstr_csv_reader_get_field(dstr_csv_reader_t *reader, int64_t index)
 {
-    if (is_dstr_arr_null(dstr_array, __func__)
-        || check_index(&index, dstr_array->size, __func__)
-        || is_dstr_null(dstr_input, __func__))
+    if (is_csv_reader_null(reader, __func__)
+        || check_index(&index, reader->num_of_fields, __func__))
     {
-        return;
+        return (dstr_view_t){NULL, 0};
     }
 
-    dstr_free(&dstr_array->data_set[index]);
-    dstr_array->data_set[index] = dstr_input;
+    return reader->fields[index];
 }
 
-void dstr_arr_set(dstr_arr_t *dstr_array, int64_t index, const char *data)
+void dstr_csv_reader_free(dstr_csv_reader_t **reader)
 {
-    if (is_dstr_arr_null(dstr_array, __func__)
-        || check_index(&index, dstr_array->size, __func__)
-        || is_str_null(data, __func__))
+    if (is_pointer_null(reader, __func__)
+        || is_csv_reader_null(*reader, __func__))
     {
         return;
     }
 
-    dstr_free(&dstr_array->data_set[index]);
-    dstr_array->data_set[index] = dstr_alloc(data);
-}
+    PROFILE_FUNC(0);
 
-size_t dstr_arr_get_size(dstr_arr_t *dstr_array)
-{
-    if (is_dstr_arr_null(dstr_array, __func__))
+    if ((*reader)->buffer != NULL)
     {
-        return 0;
+        dstr_free(&(*reader)->buffer);
     }
 
-    return dstr_array->size;
+    dstr_free(&(*reader)->scratch);
+    mem_free((*reader)->raw_fields, sizeof(csv_field_t) * (*reader)->fields_capacity);
+    mem_free((*reader)->fields, sizeof(dstr_view_t) * (*reader)->fields_capacity);
+    mem_free(*reader, sizeof(dstr_csv_reader_t));
+    *reader = NULL;
 }
 
-dstr_t *dstr_arr_get_index(dstr_arr_t *dstr_array, int64_t index)
+void dstr_trans_free(dstr_trans_t **trans)
 {
-    if (is_dstr_arr_null(dstr_array, __func__)
-        || check_index(&index, dstr_array->size, __func__))
+    if (is_pointer_null(trans, __func__)
+        || is_trans_null(*trans, __func__))
     {
-        return NULL;
+        return;
     }
 
-    return dstr_array->data_set[index];
+    PROFILE_FUNC(0);
+
+    mem_free(*trans, sizeof(dstr_trans_t));
+    *trans = NULL;
 }
 
-dstr_arr_t *dstr_arr_alloc(size_t size)
+dstr_writer_t *dstr_writer_alloc(int fd, size_t buffer_size)
 {
-    if (is_size_zero(size, __func__))
+    if (fd < 0)
     {
+        printf("%s: %swarning:%s fd is not valid%s\n", __func__, PURPLE, WHITE, RESET);
         return NULL;
     }
 
-    dstr_arr_t *dstr_array = alloc_mem(sizeof(dstr_arr_t));
-    dstr_array->size = size;
-    dstr_array->data_set = alloc_mem(dstr_array->size * sizeof(dstr_t*));
+    PROFILE_FUNC(0);
 
-    for (size_t i = 0; i < dstr_array->size; i++)
-    {
-        dstr_array->data_set[i] = dstr_alloc("");
-    }
+    dstr_writer_t *writer = mem_alloc(sizeof(dstr_writer_t));
 
-    return dstr_array;
+    writer->fd = fd;
+    writer->is_failed = false;
+    writer->size = 0;
+    writer->capacity = (buffer_size == 0) ? WRITER_BUFFER_SIZE : buffer_size;
+    writer->buffer = mem_alloc(sizeof(char) * writer->capacity);
+
+    return writer;
 }
 
-dstr_arr_t *dstr_arr_alloc_strs(size_t size, ...)
+void dstr_writer_write(dstr_writer_t *writer, const char *data)
 {
-    if (is_size_zero(size, __func__))
+    if (is_writer_null(writer, __func__)
+        || is_str_null(data, __func__))
     {
-        return NULL;
+        return;
     }
 
-    dstr_arr_t *dstr_array = alloc_mem(sizeof(dstr_arr_t));
-    dstr_array->size = size;
-    dstr_array->data_set = alloc_mem(dstr_array->size * sizeof(dstr_t*));
+    PROFILE_FUNC(0);
 
-    va_list args;
-    va_start(args, size);
+    write_to_writer(writer, data, strlen(data));
+}
 
-    for (size_t i = 0; i < dstr_array->size; i++)
+void dstr_writer_write_dstr(dstr_writer_t *writer, dstr_t *dstr)
+{
+    if (is_writer_null(writer, __func__)
+        || is_dstr_null(dstr, __func__))
     {
-        dstr_array->data_set[i] = dstr_alloc(va_arg(args, char*));
+        return;
     }
 
-    va_end(args);
+    PROFILE_FUNC(dstr->size);
 
-    return dstr_array;
+    write_to_writer(writer, dstr->data, dstr->size);
 }
 
-dstr_arr_t *dstr_arr_alloc_dstrs(size_t size, ...)
+void dstr_writer_write_line(dstr_writer_t *writer, dstr_t *dstr)
 {
-    if (is_size_zero(size, __func__))
+    if (is_writer_null(writer, __func__)
+        || is_dstr_null(dstr, __func__))
     {
-        return NULL;
+        return;
     }
 
-    dstr_arr_t *dstr_array = alloc_mem(sizeof(dstr_arr_t));
-    dstr_array->size = size;
-    dstr_array->data_set = alloc_mem(dstr_array->size * sizeof(dstr_t*));
+    PROFILE_FUNC(dstr->size);
 
-    va_list args;
-    va_start(args, size);
+    write_to_writer(writer, dstr->data, dstr->size);
+    write_to_writer(writer, "\n", 1);
+}
 
-    for (size_t i = 0; i < dstr_array->size; i++)
+bool dstr_writer_flush(dstr_writer_t *writer)
+{
+    if (is_writer_null(writer, __func__))
     {
-        dstr_array->data_set[i] = va_arg(args, dstr_t*);
+        return false;
     }
 
-    va_end(args);
+    PROFILE_FUNC(writer->size);
 
-    return dstr_array;
+    return flush_writer(writer, NULL, 0);
 }
 
-dstr_arr_t *dstr_alloc_splitstr(const char *data, const char *separator, size_t max_split)
+void dstr_writer_free(dstr_writer_t **writer)
 {
-    if (is_not_valid_str(data, __func__)
-        || is_not_valid_str(separator, __func__))
+    if (is_pointer_null(writer, __func__)
+        || is_writer_null(*writer, __func__))
     {
-        return NULL;
+        return;
     }
 
-    return alloc_split_str(data, strlen(data), separator, max_split);
+    PROFILE_FUNC(0);
+
+    flush_writer(*writer, NULL, 0);
+
+    mem_free((*writer)->buffer, sizeof(char) * (*writer)->capacity);
+    mem_free(*writer, sizeof(dstr_writer_t));
+    *writer = NULL;
 }
 
-dstr_arr_t *dstr_alloc_splitdstr(dstr_t *dstr, const char *separator, size_t max_split)
+dstr_proc_result_t *dstr_proc_run_many(const char **cmds, size_t num_of_cmds)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_not_valid_str(separator, __func__))
+    if (is_pointer_null(cmds, __func__)
+        || is_size_zero(num_of_cmds, __func__))
     {
         return NULL;
     }
 
-    return alloc_split_str(dstr->data, dstr->size, separator, max_split);
-}
-
-dstr_arr_t *dstr_arr_alloc_prompt(size_t size, ...)
-{
-    if (is_size_zero(size, __func__))
+    for (size_t i = 0; i < num_of_cmds; i++)
     {
-        return NULL;
+        if (is_not_valid_str(cmds[i], __func__))
+        {
+            return NULL;
+        }
     }
 
-    dstr_arr_t *dstr_array = dstr_arr_alloc(size);
+    PROFILE_FUNC(0);
 
-    va_list args;
-    va_start(args, size);
+    proc_runner_t runner = {.cmds = cmds, .num_of_cmds = num_of_cmds};
+    runner.results = mem_alloc(num_of_cmds * sizeof(dstr_proc_result_t));
 
-    for (size_t i = 0; i < dstr_array->size; i++)
+    for (size_t i = 0; i < num_of_cmds; i++)
     {
-        dstr_arr_set_dstr(dstr_array, (int64_t)i, dstr_alloc_prompt(va_arg(args, char*)));
+        runner.results[i].output = alloc_dstr();
+        runner.results[i].error = alloc_dstr();
+        runner.results[i].exit_status = -1;
+        set_empty_dstr(runner.results[i].output);
+        set_empty_dstr(runner.results[i].error);
     }
 
-    va_end(args);
+    run_procs(&runner);
 
-    return dstr_array;
+    return runner.results;
 }
 
-bool dstr_arr_cmp(dstr_arr_t *dstr_array, int64_t index, const char *data)
+bool dstr_proc_stream_many(const char **cmds, size_t num_of_cmds, int *exit_statuses,
+                           void (*func)(size_t cmd_index, bool is_error, const char *data, size_t size, void *context),
+                           void *context)
 {
-    if (is_str_null(data, __func__)
-        || is_dstr_arr_null(dstr_array, __func__)
-        || check_index(&index, dstr_array->size, __func__))
+    if (is_pointer_null(cmds, __func__)
+        || is_size_zero(num_of_cmds, __func__))
+    {
+        return false;
+    }
+    else if (func == NULL)
     {
+        printf("%s: %swarning:%s func is NULL%s\n", __func__, PURPLE, WHITE, RESET);
         return false;
     }
 
-    return !(strcmp(data, (dstr_array->data_set[index]->data)));
+    for (size_t i = 0; i < num_of_cmds; i++)
+    {
+        if (is_not_valid_str(cmds[i], __func__))
+        {
+            return false;
+        }
+    }
+
+    PROFILE_FUNC(0);
+
+    proc_runner_t runner = {.cmds = cmds, .num_of_cmds = num_of_cmds, .exit_statuses = exit_statuses, .func = func, .context = context};
+    runner.buffer = mem_alloc(sizeof(char) * PROC_READ_SIZE);
+
+    run_procs(&runner);
+
+    mem_free(runner.buffer, sizeof(char) * PROC_READ_SIZE);
+
+    return true;
 }
 
-bool dstr_arr_cmp_dstr(dstr_arr_t *dstr_array, int64_t index, dstr_t *dstr)
+void dstr_proc_results_free(dstr_proc_result_t **results, size_t num_of_cmds)
 {
-    if (is_dstr_null(dstr, __func__)
-        || is_dstr_arr_null(dstr_array, __func__)
-        || check_index(&index, dstr_array->size, __func__))
+    if (is_pointer_null(results, __func__)
+        || is_pointer_null(*results, __func__))
     {
-        return false;
+        return;
     }
 
-    return !(strcmp(dstr->data, (dstr_array->data_set[index]->data)));
+    PROFILE_FUNC(0);
+
+    for (size_t i = 0; i < num_of_cmds; i++)
+    {
+        dstr_free(&(*results)[i].output);
+        dstr_free(&(*results)[i].error);
+    }
+
+    mem_free(*results, num_of_cmds * sizeof(dstr_proc_result_t));
+    *results = NULL;
 }
 
-void dstr_arr_print(dstr_arr_t *dstr_array, const char *beginning, const char *end)
+#if defined(DSTR_PROFILE)
+static void add_to_profile_entry(dstr_profile_entry_t *entry, profile_counter_t *counter)
 {
-    if (is_dstr_arr_null(dstr_array, __func__)
-        || is_str_null(beginning, __func__)
-        || is_str_null(end, __func__))
+    entry->calls += atomic_load_explicit(&counter->calls, memory_order_relaxed);
+    entry->bytes += atomic_load_explicit(&counter->bytes, memory_order_relaxed);
+    entry->reallocs += atomic_load_explicit(&counter->reallocs, memory_order_relaxed);
+    entry->total_ns += atomic_load_explicit(&counter->total_ns, memory_order_relaxed);
+
+    for (size_t i = 0; i < DSTR_PROFILE_NUM_OF_BUCKETS; i++)
     {
-        return;
+        entry->histogram[i] += atomic_load_explicit(&counter->histogram[i], memory_order_relaxed);
+    }
+}
+#endif
+
+size_t dstr_profile_snapshot(dstr_profile_entry_t *entries, size_t max_entries)
+{
+#if defined(DSTR_PROFILE)
+    if (entries == NULL && max_entries > 0)
+    {
+        is_pointer_null(entries, __func__);
+        return 0;
     }
 
-    size_t i;
-    size_t last_index = (dstr_array->size-1);
+    pthread_mutex_lock(&profile_lock);
 
-    printf("%s{", beginning);
+    size_t num_of_entries = atomic_load_explicit(&num_of_profiled, memory_order_acquire);
 
-    for (i = 0; i < last_index; i++)
+    for (size_t i = 0; i < num_of_entries && i < max_entries; i++)
     {
-        printf("\"%s\", ", dstr_array->data_set[i]->data);
+        dstr_profile_entry_t *entry = &entries[i];
+
+        memset(entry, 0, sizeof(dstr_profile_entry_t));
+        entry->name = profile_names[i];
+
+        add_to_profile_entry(entry, &retired_profile.counters[i]);
+
+        for (profile_shard_t *shard = profile_shards; shard != NULL; shard = shard->next)
+        {
+            add_to_profile_entry(entry, &shard->counters[i]);
+        }
     }
 
-    printf("\"%s\"}%s", dstr_array->data_set[i]->data, end);
+    pthread_mutex_unlock(&profile_lock);
+
+    return num_of_entries;
+#else
+    (void)entries;
+    (void)max_entries;
+
+    return 0;
+#endif
 }
 
-void dstr_arr_free(dstr_arr_t **dstr_array)
+void dstr_profile_dump(FILE *fp)
 {
-    if (is_pointer_null(dstr_array, __func__)
-        || is_dstr_arr_null(*dstr_array, __func__))
+    if (is_pointer_null(fp, __func__))
     {
         return;
     }
 
-    for (size_t i = 0; i < (*dstr_array)->size; i++)
+#if defined(DSTR_PROFILE)
+    dstr_profile_entry_t *entries = calloc(PROFILE_MAX_FUNCS, sizeof(dstr_profile_entry_t));
+    size_t num_of_entries = dstr_profile_snapshot(entries, PROFILE_MAX_FUNCS);
+
+    fprintf(fp, "%-32s %12s %16s %10s %14s  %s\n", "function", "calls", "bytes", "reallocs", "avg_ns", "histogram (log2 ns: calls)");
+
+    for (size_t i = 0; i < num_of_entries; i++)
     {
-        dstr_free(&(*dstr_array)->data_set[i]);
+        dstr_profile_entry_t *entry = &entries[i];
+
+        if (entry->calls == 0)
+        {
+            continue;
+        }
+
+        fprintf(fp, "%-32s %12llu %16llu %10llu %14.1f ", entry->name, (unsigned long long)entry->calls,
+                (unsigned long long)entry->bytes, (unsigned long long)entry->reallocs,
+                (double)entry->total_ns / (double)entry->calls);
+
+        for (size_t j = 0; j < DSTR_PROFILE_NUM_OF_BUCKETS; j++)
+        {
+            if (entry->histogram[j] > 0)
+            {
+                fprintf(fp, " %zu:%llu", j, (unsigned long long)entry->histogram[j]);
+            }
+        }
+
+        fprintf(fp, "\n");
     }
 
-    free_mem((*dstr_array)->data_set, (*dstr_array)->size * sizeof(dstr_t*));
-    free_mem(*dstr_array, sizeof(dstr_arr_t));
-    *dstr_array = NULL;
+    free(entries);
+#else
+    fprintf(fp, "dstring was built without DSTR_PROFILE\n");
+#endif
 }
@@ -4,17 +4,81 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
 #include <stdarg.h>
-#include "../C_Allocation_Metrics/allocation_metrics.h"
-#include "../C_Prompt/prompt.h"
+
+#define DSTR_PROFILE_NUM_OF_BUCKETS 32
+
+// Character classes of dstr_classify, ASCII only like the case functions.
+// space is isspace in the C locale. An empty str is only ascii, like in Python.
+#define DSTR_CLASS_DIGIT            (1 << 0)
+#define DSTR_CLASS_ALPHA            (1 << 1)
+#define DSTR_CLASS_ALNUM            (1 << 2)
+#define DSTR_CLASS_SPACE            (1 << 3)
+#define DSTR_CLASS_UPPER            (1 << 4)
+#define DSTR_CLASS_LOWER            (1 << 5)
+#define DSTR_CLASS_ASCII            (1 << 6)
+#define DSTR_CLASS_ALL              0x7F
 
 typedef struct dstr dstr_t;
 typedef struct dstr_arr dstr_arr_t;
+typedef struct dstr_index_arr dstr_index_arr_t;
+typedef struct dstr_glob dstr_glob_t;
+typedef struct dstr_intern dstr_intern_t;
+typedef struct dstr_map dstr_map_t;
+typedef struct dstr_writer dstr_writer_t;
+typedef struct dstr_snapshot dstr_snapshot_t;
+typedef struct dstr_trans dstr_trans_t;
+typedef struct dstr_digest dstr_digest_t;
+typedef struct dstr_csv_reader dstr_csv_reader_t;
+
+// Totals of one function across all threads, only filled in DSTR_PROFILE builds.
+// histogram[i] counts the calls that took [2^i, 2^(i+1)) ns.
+typedef struct dstr_profile_entry
+{
+    const char *name;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t reallocs;
+    uint64_t total_ns;
+    uint64_t histogram[DSTR_PROFILE_NUM_OF_BUCKETS];
+} dstr_profile_entry_t;
+
+// Totals over all threads, see dstr_metrics_snapshot. dstring counts its
+// own allocations here, the global allocation_metrics counters don't see them.
+typedef struct dstr_metrics
+{
+    size_t num_of_allocs;
+    size_t current_bytes;
+    size_t peak_bytes;
+    size_t num_of_dstrs;
+    // Bytes reserved by dstrs but not holding chars.
+    size_t capacity_slack;
+} dstr_metrics_t;
+
+// Chars owned by something else, like an opened snapshot or a CSV reader.
+// data isn't always followed by a '\0', size is what counts.
+typedef struct dstr_view
+{
+    const char *data;
+    size_t size;
+} dstr_view_t;
+
+// Output of one command run by dstr_proc_run_many. exit_status is the exit
+// code, 128 + the signal if the command was killed, or -1 if it couldn't be started.
+typedef struct dstr_proc_result
+{
+    dstr_t *output;
+    dstr_t *error;
+    int exit_status;
+} dstr_proc_result_t;
 
 size_t str_ascii_total(const char *data);
+size_t dstr_get_num_of_allocs(void);
+dstr_metrics_t dstr_metrics_snapshot(void);
 
 /*
 void dstr_set_size(dstr_t *str, int64_t size);
@@ -38,13 +102,22 @@ dstr_t *dstr_alloc_substr(const char *data, int64_t *start_opt, int64_t *end_opt
 dstr_t *dstr_alloc_subdstr(dstr_t *dstr, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt);
 bool dstr_is_substr(const char *big, const char *little);
 bool dstr_is_subdstr(dstr_t *big, dstr_t *little);
+bool dstr_is_isubstr(const char *big, const char *little);
+bool dstr_is_isubdstr(dstr_t *big, dstr_t *little);
 void dstr_replace(dstr_t *dstr, const char *old_str, const char *new_str);
 void dstr_replace_count(dstr_t *dstr, const char *old_str, const char *new_str, size_t count);
+void dstr_ireplace(dstr_t *dstr, const char *old_str, const char *new_str);
+void dstr_ireplace_count(dstr_t *dstr, const char *old_str, const char *new_str, size_t count);
 void dstr_erase(dstr_t *dstr, const char *data);
 void dstr_erase_count(dstr_t *dstr, const char *data, int64_t count);
 void dstr_erase_index(dstr_t *dstr, int64_t start, int64_t end);
 size_t dstr_find(dstr_t *dstr, const char *search_val);
+int64_t dstr_find_from(dstr_t *dstr, const char *search_val, int64_t start);
+int64_t dstr_rfind(dstr_t *dstr, const char *search_val);
+size_t dstr_find_all(dstr_t *dstr, const char *search_val, bool is_overlapping, dstr_index_arr_t *index_array);
 size_t dstr_count(dstr_t *dstr, const char *search_val, int64_t start, int64_t end);
+size_t dstr_ifind(dstr_t *dstr, const char *search_val);
+size_t dstr_icount(dstr_t *dstr, const char *search_val, int64_t start, int64_t end);
 void dstr_lstrip(dstr_t *dstr, const char *characters);
 void dstr_rstrip(dstr_t *dstr, const char *characters);
 void dstr_strip(dstr_t *dstr);
@@ -59,13 +132,47 @@ dstr_t *dstr_alloc_prompt(const char *output_message);
 dstr_t *dstr_alloc_read_file(const char *path, const char *mode);
 void dstr_write_file(dstr_t *dstr, const char *path, const char *mode);
 dstr_t *dstr_alloc_sys_output(const char *cmd);
+bool dstr_getline(dstr_t *dstr, FILE *fp);
 size_t dstr_ascii_total(dstr_t *dstr);
+// The _update functions and dstr_digest_t take input in chunks, and give
+// the same result as one call over all of it. dstr_digest64 is XXH64 with seed 0.
+size_t dstr_ascii_total_update(size_t total, const char *data, size_t size);
+uint32_t dstr_crc32c(dstr_t *dstr);
+uint32_t dstr_crc32c_update(uint32_t crc, const char *data, size_t size);
+uint64_t dstr_digest64(dstr_t *dstr);
+dstr_digest_t *dstr_digest_alloc(uint64_t seed);
+void dstr_digest_update(dstr_digest_t *digest, const char *data, size_t size);
+uint64_t dstr_digest_get(dstr_digest_t *digest);
+void dstr_digest_free(dstr_digest_t **digest);
 int64_t dstr_ll(dstr_t *dstr);
 double dstr_double(dstr_t *dstr);
 dstr_t *dstr_alloc_ll_to_dstr(int64_t number);
 dstr_t *dstr_alloc_ll_to_binary_dstr(int64_t number, size_t bits_shown);
 dstr_t *dstr_alloc_str_to_binary_dstr(const char *number, size_t bits_shown);
 dstr_t *dstr_alloc_dstr_to_binary_dstr(dstr_t *dstr, size_t bits_shown);
+bool dstr_utf8_is_valid(dstr_t *dstr);
+size_t dstr_utf8_len(dstr_t *dstr);
+size_t dstr_utf8_offset(dstr_t *dstr, int64_t index);
+uint32_t dstr_utf8_char_at(dstr_t *dstr, int64_t index);
+dstr_t *dstr_alloc_utf8_subdstr(dstr_t *dstr, int64_t *start_opt, int64_t *end_opt, int64_t *step_opt);
+uint64_t dstr_hash(dstr_t *dstr);
+uint64_t dstr_hash_str(const char *data, size_t size);
+bool dstr_is_digit(dstr_t *dstr);
+bool dstr_is_alpha(dstr_t *dstr);
+bool dstr_is_alnum(dstr_t *dstr);
+bool dstr_is_space(dstr_t *dstr);
+bool dstr_is_upper(dstr_t *dstr);
+bool dstr_is_lower(dstr_t *dstr);
+bool dstr_is_ascii(dstr_t *dstr);
+uint8_t dstr_classify(dstr_t *dstr);
+bool dstr_view_is_digit(dstr_view_t view);
+bool dstr_view_is_alpha(dstr_view_t view);
+bool dstr_view_is_alnum(dstr_view_t view);
+bool dstr_view_is_space(dstr_view_t view);
+bool dstr_view_is_upper(dstr_view_t view);
+bool dstr_view_is_lower(dstr_view_t view);
+bool dstr_view_is_ascii(dstr_view_t view);
+uint8_t dstr_view_classify(dstr_view_t view);
 dstr_t *dstr_alloc_copy(dstr_t *dstr);
 void dstr_print(dstr_t *dstr, const char *beginning, const char *end);
 void dstr_free(dstr_t **dstr);
@@ -84,10 +191,141 @@ dstr_arr_t *dstr_arr_alloc_strs(size_t size, ...);
 dstr_arr_t *dstr_arr_alloc_dstrs(size_t size, ...);
 dstr_arr_t *dstr_alloc_splitstr(const char *data, const char *separator, size_t max_split);
 dstr_arr_t *dstr_alloc_splitdstr(dstr_t *dstr, const char *separator, size_t max_split);
+dstr_arr_t *dstr_split_parallel(dstr_t *dstr, const char *separator, size_t num_of_threads);
+// Whitespace runs are one separator and empty fields are dropped, like
+// Python's split(). With a charset every byte in it separates, and empty
+// fields are kept. max_split of 0 means no limit, rsplit counts from the end.
+// Splitting only whitespace gives an array of size 0, as does
+// dstr_arr_read_lines on an empty stream. The dstr_arr functions accept it.
+dstr_arr_t *dstr_split_whitespace(dstr_t *dstr, size_t max_split);
+dstr_arr_t *dstr_rsplit_whitespace(dstr_t *dstr, size_t max_split);
+dstr_arr_t *dstr_split_any(dstr_t *dstr, const char *charset, size_t max_split);
+dstr_arr_t *dstr_rsplit_any(dstr_t *dstr, const char *charset, size_t max_split);
 dstr_arr_t *dstr_arr_alloc_prompt(size_t size, ...);
+dstr_arr_t *dstr_arr_read_lines(FILE *fp);
+// Reads the files on the thread pool, in the same modes as dstr_alloc_read_file.
+// A file that can't be read warns and gives an empty dstr.
+dstr_arr_t *dstr_arr_read_files(const char **paths, size_t num_of_paths, const char *mode);
 bool dstr_arr_cmp(dstr_arr_t *dstr_array, int64_t index, const char *data);
 bool dstr_arr_cmp_dstr(dstr_arr_t *dstr_array, int64_t index, dstr_t *dstr);
 void dstr_arr_print(dstr_arr_t *dstr_array, const char *beginning, const char *end);
 void dstr_arr_free(dstr_arr_t **dstr_array);
+bool dstr_arr_write_lines(dstr_arr_t *dstr_array, int fd);
+bool dstr_arr_save_snapshot(dstr_arr_t *dstr_array, const char *path);
+void dstr_arr_parallel_for_each(dstr_arr_t *dstr_array, void (*func)(dstr_t *dstr, void *context), void *context);
+void dstr_arr_strip_all(dstr_arr_t *dstr_array);
+void dstr_arr_strip_chars_all(dstr_arr_t *dstr_array, const char *characters);
+void dstr_arr_lower_all(dstr_arr_t *dstr_array);
+void dstr_arr_upper_all(dstr_arr_t *dstr_array);
+void dstr_arr_replace_all(dstr_arr_t *dstr_array, const char *old_str, const char *new_str);
+// Sorts in byte order, like strcmp. is_parallel sorts large arrays on the thread pool.
+void dstr_arr_sort(dstr_arr_t *dstr_array, bool is_parallel);
+void dstr_arr_sort_stable(dstr_arr_t *dstr_array, bool is_parallel);
+size_t dstr_arr_sort_unique(dstr_arr_t *dstr_array, bool is_parallel);
+// Fills classes[i] with dstr_classify of element i.
+void dstr_arr_classify(dstr_arr_t *dstr_array, uint8_t *classes);
+
+dstr_index_arr_t *dstr_index_arr_alloc(void);
+size_t dstr_index_arr_get_size(dstr_index_arr_t *index_array);
+size_t dstr_index_arr_get_index(dstr_index_arr_t *index_array, int64_t index);
+const size_t *dstr_index_arr_get_data(dstr_index_arr_t *index_array);
+void dstr_index_arr_clear(dstr_index_arr_t *index_array);
+void dstr_index_arr_free(dstr_index_arr_t **index_array);
+
+dstr_glob_t *dstr_glob_alloc(const char *pattern);
+bool dstr_glob_match(dstr_glob_t *glob, dstr_t *dstr);
+bool dstr_glob_match_str(dstr_glob_t *glob, const char *data);
+size_t dstr_arr_filter_glob(dstr_arr_t *dstr_array, dstr_glob_t *glob, dstr_index_arr_t *index_array);
+void dstr_glob_free(dstr_glob_t **glob);
+
+// The interned dstrs belong to the table, so they must not be changed or freed,
+// and equal contents give the same pointer.
+dstr_intern_t *dstr_intern_alloc(void);
+dstr_t *dstr_intern(dstr_intern_t *intern, const char *data);
+dstr_t *dstr_intern_dstr(dstr_intern_t *intern, dstr_t *dstr);
+dstr_t *dstr_intern_find(dstr_intern_t *intern, const char *data);
+size_t dstr_intern_get_size(dstr_intern_t *intern);
+void dstr_intern_free(dstr_intern_t **intern);
+
+// The map keeps its own copies of the keys. dstr_map_next walks the keys
+// in no particular order, starting with *iterator == 0.
+dstr_map_t *dstr_map_alloc(size_t size);
+dstr_map_t *dstr_map_alloc_arr(dstr_arr_t *dstr_array, void **values);
+void dstr_map_reserve(dstr_map_t *map, size_t size);
+bool dstr_map_set(dstr_map_t *map, const char *key, void *value);
+bool dstr_map_set_dstr(dstr_map_t *map, dstr_t *key, void *value);
+void *dstr_map_get(dstr_map_t *map, const char *key);
+void *dstr_map_get_dstr(dstr_map_t *map, dstr_t *key);
+void *dstr_map_get_bytes(dstr_map_t *map, const char *key, size_t size);
+bool dstr_map_contains(dstr_map_t *map, const char *key);
+bool dstr_map_contains_dstr(dstr_map_t *map, dstr_t *key);
+bool dstr_map_erase(dstr_map_t *map, const char *key);
+bool dstr_map_erase_dstr(dstr_map_t *map, dstr_t *key);
+size_t dstr_map_get_size(dstr_map_t *map);
+bool dstr_map_next(dstr_map_t *map, size_t *iterator, dstr_t **key, void **value);
+void dstr_map_free(dstr_map_t **map);
+
+// An opened snapshot maps the file saved by dstr_arr_save_snapshot.
+// Its views stay valid until dstr_snapshot_free. Opening only checks the
+// header, and each view checks its own bounds. dstr_snapshot_verify
+// checks the crc32c of the whole file.
+dstr_snapshot_t *dstr_arr_open_snapshot(const char *path);
+size_t dstr_snapshot_get_size(dstr_snapshot_t *snapshot);
+dstr_view_t dstr_snapshot_get_view(dstr_snapshot_t *snapshot, int64_t index);
+dstr_arr_t *dstr_snapshot_alloc_arr(dstr_snapshot_t *snapshot);
+bool dstr_snapshot_verify(dstr_snapshot_t *snapshot);
+void dstr_snapshot_free(dstr_snapshot_t **snapshot);
+
+// Byte mapping in the style of Python's str.maketrans and str.translate,
+// dstr_translate maps and deletes in place in one pass.
+dstr_trans_t *dstr_maketrans(const char *from, const char *to, const char *deleted);
+void dstr_translate(dstr_t *dstr, dstr_trans_t *trans);
+void dstr_trans_free(dstr_trans_t **trans);
+
+// In place escaping. The unescape functions leave the dstr as it was and
+// return false if an escape isn't valid.
+void dstr_escape_json(dstr_t *dstr);
+bool dstr_unescape_json(dstr_t *dstr);
+void dstr_escape_c(dstr_t *dstr);
+bool dstr_unescape_c(dstr_t *dstr);
+void dstr_quote_shell(dstr_t *dstr);
+
+// The decode functions append the decoded bytes, or nothing and return false
+// if data isn't exactly valid. is_url picks the unpadded URL alphabet.
+void dstr_append_base64(dstr_t *dstr, const char *data, size_t size, bool is_url);
+bool dstr_decode_base64(dstr_t *dstr, const char *data, size_t size, bool is_url);
+void dstr_append_hex(dstr_t *dstr, const char *data, size_t size);
+bool dstr_decode_hex(dstr_t *dstr, const char *data, size_t size);
+
+// Fields in double quotes can hold delimiters and newlines, and "" in them is
+// one quote. Records end with \n or \r\n. The field views stay valid until
+// the next dstr_csv_reader_next.
+dstr_csv_reader_t *dstr_csv_reader_alloc(const char *data, size_t size, char delimiter);
+dstr_csv_reader_t *dstr_csv_reader_alloc_stream(FILE *fp, char delimiter);
+bool dstr_csv_reader_next(dstr_csv_reader_t *reader);
+size_t dstr_csv_reader_get_num_of_fields(dstr_csv_reader_t *reader);
+dstr_view_t dstr_csv_reader_get_field(dstr_csv_reader_t *reader, int64_t index);
+void dstr_csv_reader_free(dstr_csv_reader_t **reader);
+
+// buffer_size == 0 uses a 64 KiB buffer. dstr_writer_free flushes, but
+// doesn't close fd. Flush before mixing in stdio output on the same fd.
+dstr_writer_t *dstr_writer_alloc(int fd, size_t buffer_size);
+void dstr_writer_write(dstr_writer_t *writer, const char *data);
+void dstr_writer_write_dstr(dstr_writer_t *writer, dstr_t *dstr);
+void dstr_writer_write_line(dstr_writer_t *writer, dstr_t *dstr);
+bool dstr_writer_flush(dstr_writer_t *writer);
+void dstr_writer_free(dstr_writer_t **writer);
+
+// Runs the commands with /bin/sh, up to 64 at a time, and captures their stdout
+// and stderr. dstr_proc_stream_many hands each chunk of output to func as it
+// arrives instead, on the calling thread. exit_statuses may be NULL.
+dstr_proc_result_t *dstr_proc_run_many(const char **cmds, size_t num_of_cmds);
+bool dstr_proc_stream_many(const char **cmds, size_t num_of_cmds, int *exit_statuses,
+                           void (*func)(size_t cmd_index, bool is_error, const char *data, size_t size, void *context),
+                           void *context);
+void dstr_proc_results_free(dstr_proc_result_t **results, size_t num_of_cmds);
+
+size_t dstr_profile_snapshot(dstr_profile_entry_t *entries, size_t max_entries);
+void dstr_profile_dump(FILE *fp);
 
 #endif /* DSTRING_H */